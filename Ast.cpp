@@ -0,0 +1,96 @@
+#include <charconv>
+#include <limits>
+
+#include "Ast.h"
+
+
+static_assert(CEIL < 256, "Tag must fit in a byte");
+
+Ast::Ast() {
+    clear();
+}
+
+void Ast::clear() {
+    tags_.assign(1, NONE);
+    labels_.assign(1, 0);
+    left_.assign(1, 0);
+    right_.assign(1, 0);
+    cond_.assign(1, 0);
+    first_.assign(1, 0);
+    count_.assign(1, 0);
+    fields_.clear();
+    coords_.assign(1, Coordinate());
+    names_.assign(1, std::string());
+    numbers_.assign(1, std::numeric_limits<double>::quiet_NaN());
+    ids_.clear();
+    ids_.emplace(std::string(), 0);
+}
+
+size_t Ast::size() const {
+    return tags_.size();
+}
+
+uint32_t Ast::intern(const std::string& s) {
+    auto it = ids_.find(s);
+    if (it != ids_.end()) return it->second;
+    uint32_t id = names_.size();
+    names_.push_back(s);
+    ids_.emplace(s, id);
+    //from_chars не зависит от локали; литерал из цифр и точки разбирается целиком
+    double v = std::numeric_limits<double>::quiet_NaN();
+    std::from_chars(s.data(), s.data() + s.size(), v);
+    numbers_.push_back(v);
+    return id;
+}
+
+node_id Ast::add(Tag tag, const std::string& label, const Coordinate& c) {
+    node_id n = tags_.size();
+    tags_.push_back(static_cast<uint8_t>(tag));
+    labels_.push_back(intern(label));
+    left_.push_back(0);
+    right_.push_back(0);
+    cond_.push_back(0);
+    first_.push_back(0);
+    count_.push_back(0);
+    coords_.push_back(c);
+    return n;
+}
+
+void Ast::set_tag(node_id n, Tag t) {
+    tags_[n] = static_cast<uint8_t>(t);
+}
+
+void Ast::set_left(node_id n, node_id child) {
+    left_[n] = child;
+}
+
+void Ast::set_right(node_id n, node_id child) {
+    right_[n] = child;
+}
+
+void Ast::set_cond(node_id n, node_id child) {
+    cond_[n] = child;
+}
+
+void Ast::set_fields(node_id n, const std::vector<node_id>& fields) {
+    first_[n] = fields_.size();
+    count_[n] = fields.size();
+    fields_.insert(fields_.end(), fields.begin(), fields.end());
+}
+
+node_id Ast::copy(const Ast& from, node_id n) {
+    if (!n) return 0;
+    node_id res = add(from.tag(n), from.label(n), from.coord(n));
+    node_id l = copy(from, from.left(n));
+    node_id r = copy(from, from.right(n));
+    node_id c = copy(from, from.cond(n));
+    std::vector<node_id> fields;
+    for (uint32_t i = 0; i < from.field_count(n); ++i) {
+        fields.push_back(copy(from, from.fields(n)[i]));
+    }
+    left_[res] = l;
+    right_[res] = r;
+    cond_[res] = c;
+    set_fields(res, fields);
+    return res;
+}
@@ -0,0 +1,77 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "Coordinate.h"
+
+
+typedef uint32_t node_id;   //номер узла в дереве; 0 - нет узла
+
+//дерево блока в параллельных массивах: у узла тег, номер имени, номера потомков и диапазон полей
+//в общем массиве; координаты лежат отдельно, они нужны только для замен и сообщений об ошибках.
+//Имена хранятся один раз, в узле - их номер; имя-число разбирается один раз, при добавлении.
+//Массивы заменяют арену узлов: добавление узла - запись в конец каждого массива, без отдельного выделения памяти,
+//и все дерево блока освобождается одним clear()
+class Ast {
+public:
+    Ast();
+
+    node_id add(Tag tag, const std::string& label, const Coordinate& c);
+
+    void set_tag(node_id n, Tag t);     //имя узла не меняется
+
+    void set_left(node_id n, node_id child);
+
+    void set_right(node_id n, node_id child);
+
+    void set_cond(node_id n, node_id child);
+
+    void set_fields(node_id n, const std::vector<node_id>& fields);
+
+    node_id copy(const Ast& from, node_id n);   //перенести поддерево другого дерева, вернуть его корень
+
+    void clear();
+
+    size_t size() const;    //число узлов вместе с пустым
+
+    //доступ при обходе: определены здесь, чтобы встраиваться в вычислитель и анализ
+    Tag tag(node_id n) const { return static_cast<Tag>(tags_[n]); }
+
+    uint32_t label_id(node_id n) const { return labels_[n]; }
+
+    const std::string& label(node_id n) const { return names_[labels_[n]]; }
+
+    double number(node_id n) const { return numbers_[labels_[n]]; }  //NaN, если имя - не число
+
+    const Coordinate& coord(node_id n) const { return coords_[n]; }
+
+    node_id left(node_id n) const { return left_[n]; }
+
+    node_id right(node_id n) const { return right_[n]; }
+
+    node_id cond(node_id n) const { return cond_[n]; }
+
+    const node_id *fields(node_id n) const { return fields_.data() + first_[n]; }
+
+    uint32_t field_count(node_id n) const { return count_[n]; }
+
+private:
+    std::vector<uint8_t> tags_;
+    std::vector<uint32_t> labels_;
+    std::vector<node_id> left_;
+    std::vector<node_id> right_;
+    std::vector<node_id> cond_;
+    std::vector<uint32_t> first_;       //начало полей узла в fields_
+    std::vector<uint32_t> count_;
+    std::vector<node_id> fields_;       //поля узла идут подряд
+    std::vector<Coordinate> coords_;
+
+    std::vector<std::string> names_;
+    std::vector<double> numbers_;       //значения имен-чисел
+    std::unordered_map<std::string, uint32_t> ids_;
+
+    uint32_t intern(const std::string& s);
+};
@@ -0,0 +1,62 @@
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "Ast.h"
+#include "Value.h"
+
+//команды регистровой машины: a - регистр результата, b, c, d - регистры операндов или номера,
+//n - узел дерева, по которому берутся координата ошибки и поддерево для EVAL.
+//Переменные - слоты кадра: номер в Chunk::names, имя нужно только для связывания и сообщений
+typedef enum Op : uint8_t {
+    OP_LOADK,       //a = consts[b]
+    OP_LOAD,        //a = слот b
+    OP_INDEX,       //a = (слот d)_{b} или _{b,c}; c == NOREG - индекс вектора
+    OP_STORE,       //слот a := b
+    OP_STOREIDX,    //элемент матрицы в слоте d: индексы b, c, значение a
+    OP_ADD, OP_SUB, OP_MUL, OP_DIV, OP_POW,
+    OP_EQ, OP_NEQ, OP_LT, OP_LEQ, OP_GT, OP_GEQ, OP_AND, OP_OR,
+    OP_USUB, OP_NOT, OP_ABS,
+    OP_JMP,         //перейти на d
+    OP_JZERO,       //перейти на d, если b == 0 (\ifexpr)
+    OP_JNOTONE,     //перейти на d, если b != 1 (\while, \when)
+    OP_CALL,        //a = функция из слота d с аргументами в регистрах b .. b + c - 1
+    OP_BUILTIN1,    //a = fn1[c](b), аргумент без размерности
+    OP_FLOOR1,      //a = fn1[c](b), размерность сохраняется
+    OP_BUILTIN2,    //a = fn2[c](b, b + 1)
+    OP_REPL,        //значение a - в замену \placeholder справа от EQ n
+    OP_REPLDIV,     //a / b - в замену \placeholder[...] справа от EQ n
+    OP_EVAL,        //a = поддерево n, выполненное обходом дерева
+    OP_FORINIT,     //счетчик a, граница b, переменная цикла SUM/PRODUCT - слот c
+    OP_FORTEST,     //перейти на d, если a > b, иначе записать a в слот c
+    OP_FORNEXT,     //a += 1, перейти на d
+    OP_FOREND,      //записать a в слот c
+    OP_ACCUM,       //a = a + b (c == 0) или a * b (c == 1); первое значение просто копируется
+    OP_FINISH,      //пустые сумма и произведение: a = 0 (c == 0) или 1 (c == 1)
+    OP_RET,         //вернуть a
+    OP_COUNT
+} Op;
+
+typedef struct Instr {
+    const void *handler = nullptr;  //адрес обработчика команды: код машины шитый, switch не нужен
+    Op op;
+    uint32_t a = 0, b = 0, c = 0, d = 0;
+    node_id n = 0;
+} Instr;
+
+//скомпилированное выражение: после построения не меняется, поэтому одно тело функции
+//могут выполнять несколько потоков. Команды ссылаются на узлы дерева, по которому скомпилированы,
+//дерево должно жить дольше (у тела функции это Func::code)
+typedef struct Chunk {
+    static const uint32_t NOREG = UINT32_MAX;
+
+    std::vector<Instr> code;
+    std::vector<Value> consts;
+    std::vector<double (*)(double)> fn1;
+    std::vector<double (*)(double, double)> fn2;
+    std::vector<std::string> names;     //имена слотов кадра
+    uint32_t regs = 0;      //регистров в кадре
+} Chunk;
@@ -0,0 +1,292 @@
+#include <cstring>
+#include <fstream>
+#include <iterator>
+
+#include "Cache.h"
+
+
+static const char magic[] = "TEXPPCACHE1\n";
+static const size_t max_variants = 4;   //вариантов одного текста (разные значения прочитанных имен)
+static const uint64_t max_age = 8;      //записи, не использованные столько запусков, удаляются
+static const size_t min_value_size = 1 + 7 * sizeof(uint64_t);  //тип и размерность: меньше значение занимать не может
+
+
+static void put_u64(std::string &buf, uint64_t x) {
+    buf.append(reinterpret_cast<const char *>(&x), sizeof(x));
+}
+
+static void put_str(std::string &buf, const std::string &s) {
+    put_u64(buf, s.size());
+    buf += s;
+}
+
+//false, если значение содержит функцию
+static bool put_value(std::string &buf, const Value &v) {
+    buf += static_cast<char>(v._type);
+    for (int d : v._dimension) put_u64(buf, static_cast<uint64_t>(static_cast<int64_t>(d)));
+    if (v._type == Value::DOUBLE || v._type == Value::INFERRED_DOUBLE) {
+        double x = v.get_double();
+        uint64_t bits;
+        std::memcpy(&bits, &x, sizeof(bits));
+        put_u64(buf, bits);
+    } else if (v._type == Value::MATRIX || v._type == Value::INFERRED_MATRIX) {
+        size_t rows = v.rows(), cols = v.cols();    //плотная матрица пишется так же, как общая
+        put_u64(buf, rows);
+        for (size_t i = 0; i < rows; ++i) {
+            put_u64(buf, cols);
+            for (size_t j = 0; j < cols; ++j) {
+                if (!put_value(buf, v.at(i, j))) return false;
+            }
+        }
+    } else if (v._type == Value::FUNCTION) {
+        return false;
+    }
+    return true;
+}
+
+typedef struct Reader {
+    const std::string &buf;
+    size_t pos = 0;
+    bool ok = true;
+
+    uint64_t u64() {
+        uint64_t x = 0;
+        if (pos + sizeof(x) > buf.size()) {
+            ok = false;
+            return 0;
+        }
+        std::memcpy(&x, buf.data() + pos, sizeof(x));
+        pos += sizeof(x);
+        return x;
+    }
+
+    std::string str() {
+        uint64_t n = u64();
+        if (!ok || n > buf.size() - pos) {
+            ok = false;
+            return "";
+        }
+        std::string s = buf.substr(pos, n);
+        pos += n;
+        return s;
+    }
+
+    //число элементов, которое еще может поместиться в остатке буфера, если каждый занимает не меньше size байт
+    bool fits(uint64_t n, size_t size) {
+        if (n > (buf.size() - pos) / size) ok = false;
+        return ok;
+    }
+
+    Value value() {
+        if (pos >= buf.size()) {
+            ok = false;
+            return {};
+        }
+        auto t = static_cast<unsigned char>(buf[pos++]);
+        if (t > Value::INFERRED_MATRIX) {
+            ok = false;
+            return {};
+        }
+        auto type = static_cast<Value::Type>(t);
+        std::array<int, 7> dim{};
+        for (int &d : dim) d = static_cast<int>(static_cast<int64_t>(u64()));
+        Value res;
+        if (type == Value::DOUBLE || type == Value::INFERRED_DOUBLE) {
+            uint64_t bits = u64();
+            double x;
+            std::memcpy(&x, &bits, sizeof(x));
+            res = Value(x, dim);
+        } else if (type == Value::MATRIX || type == Value::INFERRED_MATRIX) {
+            uint64_t rows = u64();
+            if (!fits(rows, sizeof(uint64_t))) return {};
+            Matrix m;
+            m.reserve(rows);
+            for (uint64_t i = 0; ok && i < rows; ++i) {
+                uint64_t cols = u64();
+                if (!fits(cols, min_value_size)) return {};
+                std::vector<Value> row;
+                row.reserve(cols);
+                for (uint64_t j = 0; ok && j < cols; ++j) row.push_back(value());
+                m.push_back(row);
+            }
+            res = Value(m, dim);
+        } else if (type != Value::UNDEFINED) {
+            ok = false;
+            return {};
+        }
+        res._type = type;
+        res._dimension = dim;
+        return res;
+    }
+} Reader;
+
+
+uint64_t Cache::hash(std::string_view s, uint64_t h) {    //FNV-1a
+    for (unsigned char c : s) {
+        h ^= c;
+        h *= 1099511628211ULL;
+    }
+    return h;
+}
+
+bool Cache::hash(const Value &v, uint64_t &h) {
+    std::string buf;
+    if (!put_value(buf, v)) return false;
+    h = hash(buf);
+    return true;
+}
+
+bool Cache::load(const std::string &path) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    path_ = path;
+    std::ifstream in(path, std::ios::binary);
+    if (!in.good()) return true;
+    std::string buf((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+    if (buf.compare(0, sizeof(magic) - 1, magic)) return false;
+
+    Reader r{buf, sizeof(magic) - 1};
+    run_ = r.u64();
+    uint64_t n = r.u64();
+    for (uint64_t i = 0; r.ok && i < n; ++i) {
+        uint64_t key = r.u64();
+        CacheEntry e;
+        e.used = r.u64();
+        uint64_t k = r.u64();
+        for (uint64_t j = 0; r.ok && j < k; ++j) {
+            std::string name = r.str();
+            e.reads.emplace_back(name, r.u64());
+        }
+        k = r.u64();
+        for (uint64_t j = 0; r.ok && j < k; ++j) {
+            std::string name = r.str();
+            e.defs.emplace_back(name, r.value());
+        }
+        k = r.u64();
+        for (uint64_t j = 0; r.ok && j < k; ++j) {
+            std::string name = r.str();
+            e.idents.emplace_back(name, r.value());
+        }
+        k = r.u64();
+        for (uint64_t j = 0; r.ok && j < k; ++j) {
+            Coordinate c;
+            c.line = r.u64();
+            c.pos = r.u64();
+            uint64_t t = r.u64();
+            if (t >= tag_count) {
+                r.ok = false;
+                break;
+            }
+            auto tag = static_cast<Tag>(t);
+            size_t b = r.u64();
+            size_t end = r.u64();
+            e.reps.emplace_back(c, Replacement(tag, b, end, r.value()));
+        }
+        if (r.ok) entries_[key].push_back(std::move(e));
+    }
+    ++run_;
+    if (!r.ok) {    //поврежденный кэш не используется
+        entries_.clear();
+        return false;
+    }
+    return true;
+}
+
+bool Cache::save() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    std::string buf = magic;
+    std::string body;
+    uint64_t n = 0;
+    for (auto &it : entries_) {
+        for (auto &e : it.second) {
+            if (e.used + max_age < run_) continue;
+            ++n;
+            put_u64(body, it.first);
+            put_u64(body, e.used);
+            put_u64(body, e.reads.size());
+            for (auto &r : e.reads) {
+                put_str(body, r.first);
+                put_u64(body, r.second);
+            }
+            put_u64(body, e.defs.size());
+            for (auto &d : e.defs) {
+                put_str(body, d.first);
+                put_value(body, d.second);
+            }
+            put_u64(body, e.idents.size());
+            for (auto &d : e.idents) {
+                put_str(body, d.first);
+                put_value(body, d.second);
+            }
+            put_u64(body, e.reps.size());
+            for (auto &r : e.reps) {
+                put_u64(body, r.first.line);
+                put_u64(body, r.first.pos);
+                put_u64(body, r.second.tag);
+                put_u64(body, r.second.begin);
+                put_u64(body, r.second.end);
+                put_value(body, r.second.replacement);
+            }
+        }
+    }
+    put_u64(buf, run_);
+    put_u64(buf, n);
+    buf += body;
+
+    std::string tmp = path_ + ".tmp";   //запись через временный файл, чтобы не оставить половину кэша
+    {
+        std::ofstream out(tmp, std::ios::binary | std::ios::trunc);
+        out.write(buf.data(), static_cast<std::streamsize>(buf.size()));
+        if (!out.good()) return false;
+    }
+    return !std::rename(tmp.c_str(), path_.c_str());
+}
+
+bool Cache::find(uint64_t key, const std::function<uint64_t(const std::string&)> &current, CacheEntry &res) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto it = entries_.find(key);
+    if (it == entries_.end()) {
+        ++stats_.misses;
+        return false;
+    }
+    for (auto &e : it->second) {
+        bool match = true;
+        for (auto &r : e.reads) {
+            if (current(r.first) != r.second) {
+                match = false;
+                break;
+            }
+        }
+        if (match) {
+            e.used = run_;
+            res = e;
+            ++stats_.hits;
+            return true;
+        }
+    }
+    ++stats_.invalidated;
+    return false;
+}
+
+void Cache::store(uint64_t key, CacheEntry e) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    e.used = run_;
+    auto &variants = entries_[key];
+    for (auto &old : variants) {
+        if (old.reads == e.reads) {
+            old = std::move(e);
+            return;
+        }
+    }
+    if (variants.size() >= max_variants) variants.erase(variants.begin());
+    variants.push_back(std::move(e));
+}
+
+void Cache::uncacheable() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    ++stats_.uncacheable;
+}
+
+CacheStats Cache::stats() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return stats_;
+}
@@ -0,0 +1,62 @@
+#pragma once
+
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "Coordinate.h"
+#include "Value.h"
+
+
+//результат блока, сохраненный при прошлом запуске
+typedef struct CacheEntry {
+    std::vector<std::pair<std::string, uint64_t>> reads;    //прочитанные глобальные имена и хэши их значений
+    std::vector<std::pair<std::string, Value>> defs;        //глобальные имена, определенные блоком
+    std::vector<std::pair<std::string, Value>> idents;      //изменения таблицы семантического анализа
+    std::vector<std::pair<Coordinate, Replacement>> reps;   //строки координат - от начала блока
+    uint64_t used = 0;                                      //номер запуска, в котором запись использовалась
+} CacheEntry;
+
+typedef struct CacheStats {
+    size_t hits = 0;
+    size_t misses = 0;          //блок с таким текстом не встречался
+    size_t invalidated = 0;     //текст тот же, но изменились прочитанные глобальные имена
+    size_t uncacheable = 0;     //блок определяет или выдает функции
+} CacheStats;
+
+
+//кэш результатов блоков на диске: ключ - хэш текста блока, запись подходит,
+//только если глобальные имена, прочитанные блоком, имеют те же значения.
+//Один кэш может использоваться несколькими потоками пакетного режима
+class Cache {
+public:
+    bool load(const std::string& path);    //отсутствующий файл - пустой кэш
+
+    bool save();
+
+    //current возвращает хэш текущего значения глобального имени
+    bool find(uint64_t key, const std::function<uint64_t(const std::string&)>& current, CacheEntry& res);
+
+    void store(uint64_t key, CacheEntry e);
+
+    void uncacheable();
+
+    CacheStats stats();
+
+    static uint64_t hash(std::string_view s, uint64_t h = 14695981039346656037ULL);
+
+    static bool hash(const Value& v, uint64_t& h);  //false для функций: их значение не сериализуется
+
+private:
+    std::string path_;
+    std::unordered_map<uint64_t, std::vector<CacheEntry>> entries_;
+    uint64_t run_ = 0;
+    CacheStats stats_;
+    std::mutex mutex_;
+};
@@ -0,0 +1,327 @@
+#include <cmath>
+
+#include "Compiler.h"
+#include "Vm.h"
+
+
+//команда бинарной операции; OP_COUNT - у тега своей команды нет
+static Op binary(Tag t) {
+    switch (t) {
+        case ADD: return OP_ADD;
+        case SUB: return OP_SUB;
+        case MUL: return OP_MUL;
+        case DIV:
+        case FRAC: return OP_DIV;
+        case POW: return OP_POW;
+        case NEQ: return OP_NEQ;
+        case LT: return OP_LT;
+        case LEQ: return OP_LEQ;
+        case GT: return OP_GT;
+        case GEQ: return OP_GEQ;
+        case AND: return OP_AND;
+        case OR: return OP_OR;
+        default: return OP_COUNT;
+    }
+}
+
+Compiler::Compiler(const Ast &ast) : ast_(ast) {}
+
+std::shared_ptr<const Chunk> Compiler::compile(node_id root) {
+    chunk_ = std::make_shared<Chunk>();
+    top_ = 0;
+    slots_.clear();
+    uint32_t r = reg();
+    expr(root, r);
+    emit(OP_RET, r);
+    Vm::thread(*chunk_);
+    return std::move(chunk_);
+}
+
+uint32_t Compiler::reg() {
+    uint32_t r = top_++;
+    if (chunk_->regs < top_) chunk_->regs = top_;
+    return r;
+}
+
+uint32_t Compiler::slot(node_id n) {
+    auto res = slots_.emplace(ast_.label(n), chunk_->names.size());
+    if (res.second) chunk_->names.push_back(ast_.label(n));
+    return res.first->second;
+}
+
+void Compiler::release(uint32_t r) {
+    top_ = r;
+}
+
+size_t Compiler::emit(Op op, uint32_t a, uint32_t b, uint32_t c, uint32_t d, node_id n) {
+    Instr i;
+    i.op = op;
+    i.a = a;
+    i.b = b;
+    i.c = c;
+    i.d = d;
+    i.n = n;
+    chunk_->code.push_back(i);
+    return chunk_->code.size() - 1;
+}
+
+uint32_t Compiler::here() const {
+    return chunk_->code.size();
+}
+
+void Compiler::patch(size_t jump) {
+    chunk_->code[jump].d = here();
+}
+
+void Compiler::constant(uint32_t dst, const Value &v) {
+    emit(OP_LOADK, dst, chunk_->consts.size());
+    chunk_->consts.push_back(v);
+}
+
+//результат узла n - в регистр dst; used == false - значение не нужно (оператор блока не последний)
+void Compiler::expr(node_id n, uint32_t dst, bool used) {
+    Tag tag = ast_.tag(n);
+
+    Op op = binary(tag);
+    if (op != OP_COUNT) {
+        expr(ast_.left(n), dst);
+        uint32_t r = reg();
+        expr(ast_.right(n), r);
+        release(r);
+        emit(op, dst, dst, r, 0, n);
+        return;
+    }
+
+    switch (tag) {
+        case NUMBER:
+            if (std::isnan(ast_.number(n))) break;  //ошибку разбора выдаст обход дерева
+            constant(dst, Value(ast_.number(n), Value::dimensionless));
+            return;
+        case DIMENSION:
+            constant(dst, Value(*dimensions.find(ast_.label(n))));
+            return;
+        case IDENT: {
+            uint32_t k = ast_.field_count(n);
+            if (k == 0) {
+                emit(OP_LOAD, dst, slot(n), 0, 0, n);
+                return;
+            }
+            if (k > 2) break;
+            uint32_t i = reg();
+            expr(ast_.fields(n)[0], i);
+            uint32_t j = Chunk::NOREG;
+            if (k == 2) {
+                j = reg();
+                expr(ast_.fields(n)[1], j);
+            }
+            release(i);
+            emit(OP_INDEX, dst, i, j, slot(n), n);
+            return;
+        }
+        case FUNC: {
+            uint32_t first = top_;
+            args(n);
+            release(first);
+            emit(OP_CALL, dst, first, ast_.field_count(n), slot(n), n);
+            return;
+        }
+        case UADD:
+        case LPAREN:
+            expr(ast_.right(n), dst);
+            return;
+        case USUB:
+        case NOT:
+        case ABS:
+            expr(ast_.right(n), dst);
+            emit(tag == USUB ? OP_USUB : (tag == NOT) ? OP_NOT : OP_ABS, dst, dst, 0, 0, n);
+            return;
+        case SET:
+            if (ast_.tag(ast_.left(n)) != IDENT || ast_.field_count(ast_.left(n)) > 2) break;
+            set(n, dst, used);
+            return;
+        case EQ:
+            eq(n, dst, used);
+            return;
+        case ROOT:
+        case BEGINB:
+            block(n, dst, used);
+            return;
+        case BEGINC:
+            cases(n, dst);
+            return;
+        case IF: {
+            expr(ast_.cond(n), dst);
+            size_t other = emit(OP_JZERO, 0, dst);
+            expr(ast_.right(n), dst, used);
+            size_t end = emit(OP_JMP);
+            patch(other);
+            if (ast_.left(n)) {
+                expr(ast_.left(n), dst, used);
+            } else if (used) {
+                constant(dst, Value(0.0, Value::dimensionless));
+            }
+            patch(end);
+            return;
+        }
+        case WHILE: {
+            constant(dst, Value(0.0));
+            uint32_t test = here();
+            uint32_t c = reg();
+            expr(ast_.cond(n), c);
+            release(c);
+            size_t exit = emit(OP_JNOTONE, 0, c);
+            expr(ast_.right(n), dst, used);
+            emit(OP_JMP, 0, 0, 0, test);
+            patch(exit);
+            return;
+        }
+        case SUM:
+        case PRODUCT:
+            loop(n, dst);
+            return;
+        case KEYWORD:
+            keyword(n, dst);
+            return;
+        default:
+            break;
+    }
+    emit(OP_EVAL, dst, 0, 0, 0, n);
+}
+
+void Compiler::block(node_id n, uint32_t dst, bool used) {
+    uint32_t k = ast_.field_count(n);
+    if (k == 0) {
+        if (used) constant(dst, Value(0.0));
+        return;
+    }
+    for (uint32_t i = 0; i < k; ++i) {
+        expr(ast_.fields(n)[i], dst, used && i + 1 == k);
+    }
+}
+
+//присваивание переменной или элементу матрицы; значение SET - 0
+void Compiler::set(node_id n, uint32_t dst, bool used) {
+    node_id l = ast_.left(n);
+    uint32_t k = ast_.field_count(l);
+    if (k == 0) {
+        expr(ast_.right(n), dst);
+        emit(OP_STORE, slot(l), dst, 0, 0, n);
+    } else {
+        uint32_t i = reg();
+        expr(ast_.fields(l)[0], i);
+        uint32_t j = Chunk::NOREG;
+        if (k == 2) {
+            j = reg();
+            expr(ast_.fields(l)[1], j);
+        }
+        uint32_t v = reg();
+        expr(ast_.right(n), v);
+        release(i);
+        emit(OP_STOREIDX, v, i, j, slot(l), n);
+    }
+    if (used) constant(dst, Value(0.0, Value::dimensionless));
+}
+
+//сравнение или запись значения в \placeholder; запись возвращает 1
+void Compiler::eq(node_id n, uint32_t dst, bool used) {
+    node_id r = ast_.right(n);
+    expr(ast_.left(n), dst);
+    if (ast_.tag(r) == PLACEHOLDER) {
+        emit(OP_REPL, dst, 0, 0, 0, n);
+    } else if (ast_.left(r) && ast_.tag(ast_.left(r)) == PLACEHOLDER) {
+        uint32_t unit = reg();
+        expr(ast_.right(r), unit);
+        release(unit);
+        emit(OP_REPLDIV, dst, unit, 0, 0, n);
+    } else {
+        uint32_t t = reg();
+        expr(r, t);
+        release(t);
+        emit(OP_EQ, dst, dst, t, 0, n);
+        return;
+    }
+    if (used) constant(dst, Value(1.0, Value::dimensionless));
+}
+
+//константы и встроенные функции; неизвестное слово или неверное число аргументов - ошибка обхода дерева
+void Compiler::keyword(node_id n, uint32_t dst) {
+    const std::string &label = ast_.label(n);
+    const double *c = constants.find(label);
+    if (c) {
+        constant(dst, Value(*c));
+        return;
+    }
+    const int *argc = arg_count.find(label);
+    uint32_t k = ast_.field_count(n);
+    if (argc && *argc == int(k)) {
+        if (k == 1 && funcs1.find(label)) {
+            uint32_t r = reg();
+            expr(ast_.fields(n)[0], r);
+            release(r);
+            emit(label == "\\floor" ? OP_FLOOR1 : OP_BUILTIN1, dst, r, chunk_->fn1.size(), 0, n);
+            chunk_->fn1.push_back(*funcs1.find(label));
+            return;
+        }
+        auto f = funcs2.find(label);
+        if (k == 2 && f != funcs2.end()) {
+            uint32_t first = top_;
+            args(n);
+            release(first);
+            emit(OP_BUILTIN2, dst, first, chunk_->fn2.size(), 0, n);
+            chunk_->fn2.push_back(f->second);
+            return;
+        }
+    }
+    emit(OP_EVAL, dst, 0, 0, 0, n);
+}
+
+//\sum и \prod: счетчик и граница - в регистрах, накопитель - dst
+void Compiler::loop(node_id n, uint32_t dst) {
+    uint32_t mode = (ast_.tag(n) == SUM) ? 0 : 1;
+    uint32_t x = reg();
+    uint32_t to = reg();
+    expr(ast_.right(ast_.left(n)), x);
+    expr(ast_.cond(n), to);
+    uint32_t var = slot(ast_.left(ast_.left(n)));
+    emit(OP_FORINIT, x, to, var, 0, n);
+    constant(dst, Value());
+
+    uint32_t test = here();
+    size_t exit = emit(OP_FORTEST, x, to, var, 0, n);
+    uint32_t t = reg();
+    expr(ast_.right(n), t);
+    emit(OP_ACCUM, dst, t, mode, 0, n);
+    emit(OP_FORNEXT, x, 0, 0, test);
+    patch(exit);
+
+    emit(OP_FOREND, x, 0, var);
+    emit(OP_FINISH, dst, 0, mode);
+    release(x);
+}
+
+//первое вхождение \when с истинным условием; если такого нет - 0
+void Compiler::cases(node_id n, uint32_t dst) {
+    std::vector<size_t> ends;
+    bool otherwise = false;
+    for (uint32_t i = 0; i < ast_.field_count(n) && !otherwise; ++i) {
+        node_id alt = ast_.fields(n)[i];
+        size_t next = 0;
+        otherwise = !ast_.cond(alt);
+        if (!otherwise) {
+            expr(ast_.cond(alt), dst);
+            next = emit(OP_JNOTONE, 0, dst);
+        }
+        expr(ast_.right(alt), dst);
+        ends.push_back(emit(OP_JMP));
+        if (!otherwise) patch(next);
+    }
+    if (!otherwise) constant(dst, Value(0.0, Value::dimensionless));
+    for (size_t e : ends) patch(e);
+}
+
+//аргументы подряд в регистрах над занятыми
+void Compiler::args(node_id n) {
+    for (uint32_t i = 0; i < ast_.field_count(n); ++i) {
+        expr(ast_.fields(n)[i], reg());
+    }
+}
@@ -0,0 +1,55 @@
+#pragma once
+
+#include <map>
+#include <memory>
+#include <string>
+
+#include "Bytecode.h"
+#include "Node.h"
+
+
+//перевод дерева в команды Vm. Регистры выделяются стеком: результат узла пишется в заданный
+//регистр, временные значения лежат выше него. Узлы, для которых команд нет (матрицы, графики,
+//определения функций), выполняются обходом дерева через EVAL, поэтому компилируется любое дерево
+class Compiler {
+public:
+    explicit Compiler(const Ast &ast);
+
+    std::shared_ptr<const Chunk> compile(node_id root);
+
+private:
+    const Ast &ast_;
+    std::shared_ptr<Chunk> chunk_;
+    uint32_t top_ = 0;      //первый свободный регистр
+    std::map<std::string, uint32_t> slots_;     //имя - слот кадра
+
+    uint32_t reg();
+
+    uint32_t slot(node_id n);   //слот имени узла n, одно имя - один слот
+
+    void release(uint32_t r);
+
+    size_t emit(Op op, uint32_t a = 0, uint32_t b = 0, uint32_t c = 0, uint32_t d = 0, node_id n = 0);
+
+    uint32_t here() const;
+
+    void patch(size_t jump);    //переход jump ведет на следующую команду
+
+    void constant(uint32_t dst, const Value &v);
+
+    void expr(node_id n, uint32_t dst, bool used = true);
+
+    void block(node_id n, uint32_t dst, bool used);
+
+    void set(node_id n, uint32_t dst, bool used);
+
+    void eq(node_id n, uint32_t dst, bool used);
+
+    void keyword(node_id n, uint32_t dst);
+
+    void loop(node_id n, uint32_t dst);
+
+    void cases(node_id n, uint32_t dst);
+
+    void args(node_id n);
+};
@@ -0,0 +1,291 @@
+#include <memory>
+
+#include "Context.h"
+#include "Cache.h"
+#include "Lexer.h"
+#include "Vm.h"
+
+
+static void put_replacement(std::string_view prog, const Replacement& r, size_t& index, OutputBuffer& out) {
+	out.span(prog.substr(index, r.begin - index));
+	out.span("{");
+	if (r.tag == GRAPHIC) {
+		out.fragment(to_plot(r.replacement));
+	}
+	else {
+//	    std::cout << "second.replacement = " << to_string(r.replacement) << std::endl;
+		out.fragment(to_string(r.replacement));
+	}
+	out.span("}");
+	index = r.end;
+}
+
+void make_replacement(std::string_view prog, const replacement_map& m, OutputBuffer& out) {
+	size_t index = 0;     //неизмененные куски блока не копируются, а ссылаются на входной файл
+
+//	std::cout << "make_replacement.size = " << m.size() << std::endl;
+
+	for (auto& it : m) {
+		put_replacement(prog, it.second, index, out);
+	}
+	out.span(prog.substr(index));
+}
+
+void make_replacement(std::string_view prog, const std::vector<replacement_map>& reps, OutputBuffer& out) {
+    std::map<Coordinate, const Replacement*> m;     //замены всех операторов по порядку, значения не копируются
+    for (auto& r : reps) {
+        for (auto& it : r) m.emplace(it.first, &it.second);
+    }
+    size_t index = 0;
+    for (auto& it : m) {
+        put_replacement(prog, *it.second, index, out);
+    }
+    out.span(prog.substr(index));
+}
+
+void parse_block(const ProgramString& ps, Parsed& res) {
+    try {
+        Lexer l;
+        Parser B;
+        Tokens p;
+        l.open(ps, p);
+        replacement_map none;
+        B.init(l, p, none, res.ast);
+        node_id root = B.node(ROOT, Coordinate());
+        res.ast.set_fields(root, B.statements(res.reps));
+        res.root = Node(&res.ast, root);
+//        res.root.print("");
+    }
+    catch (...) {
+        res.error = std::current_exception();
+    }
+}
+
+void Context::run(const ProgramString& ps, OutputBuffer& out) {
+    uint64_t key = 0;
+    if (cached(ps, out, key)) return;   //лексер, парсер, анализ и выполнение не нужны
+    Parsed parsed;
+    parse_block(ps, parsed);
+    execute(ps, parsed, out, key);
+}
+
+void Context::run(const ProgramString& ps, Parsed& parsed, OutputBuffer& out) {
+    uint64_t key = 0;
+    if (cached(ps, out, key)) return;
+    execute(ps, parsed, out, key);
+}
+
+bool Context::cached(const ProgramString& ps, OutputBuffer& out, uint64_t& key) {
+    if (!cache) return false;
+    key = Cache::hash(ps.program);
+    return from_cache(key, ps, out);
+}
+
+void Context::execute(const ProgramString& ps, Parsed& parsed, OutputBuffer& out, uint64_t key) {
+    if (parsed.error) {
+        std::rethrow_exception(parsed.error);
+    }
+    reps.clear();
+    for (auto& r : parsed.reps) reps.insert(r.begin(), r.end());
+    Node res = parsed.root;
+
+    std::map<std::string, uint64_t> before;
+    Record rec;
+    if (cache) {
+        record(&rec);
+        for (auto& it : idents) before[it.first] = value_hash(it.first, it.second);
+    }
+
+    // Стадия семантического анализа для проверки корректности операций с размерными физическими величинами
+    res.semantic_analysis(*this);
+
+    eval(res);
+
+    if (cache) {
+        record(nullptr);
+        to_cache(key, ps, before, rec);
+    }
+
+    make_replacement(ps.program, reps, out);
+    reps.clear();
+    parsed.root = Node();
+    parsed.ast.clear();
+}
+
+uint64_t Context::value_hash(const std::string& name, const Value& v) {
+    uint64_t h = 0;
+    if (v._type == Value::FUNCTION) {
+        auto it = origins.find(name);
+        if (it != origins.end()) return it->second;
+    } else if (Cache::hash(v, h)) {
+        return h;
+    }
+    if (record_) record_->opaque = true;
+    return 0;
+}
+
+void Context::record(Record *r) {
+    record_ = r;
+}
+
+bool Context::set_origins(uint64_t seed, const Record& r) {
+    uint64_t origin = seed;
+    for (auto& it : r.reads) {
+        origin = Cache::hash(it.first, origin);
+        origin = Cache::hash(std::to_string(it.second), origin);
+    }
+    bool found = false;
+    for (auto& name : r.defs) {
+        auto it = global.find(name);
+        if (it != global.end() && it->second._type == Value::FUNCTION) {
+            origins[name] = Cache::hash(name, origin);
+            found = true;
+        }
+    }
+    return found;
+}
+
+void Context::note_read(const std::string& name, const Value& v) {
+    //значение, записанное самим вычислением, - не зависимость
+    if (record_->defs_only || record_->defs.count(name) || record_->reads.count(name)) return;
+    record_->reads[name] = value_hash(name, v);
+}
+
+bool Context::from_cache(uint64_t key, const ProgramString& ps, OutputBuffer& out) {
+    auto current = [this](const std::string& name) -> uint64_t {
+        auto it = global.find(name);
+        return (it == global.end()) ? 0 : value_hash(name, it->second);
+    };
+    CacheEntry e;
+    if (!cache->find(key, current, e)) return false;
+
+    for (auto& d : e.defs) global[d.first] = d.second;
+    for (auto& d : e.idents) idents[d.first] = d.second;
+    reps.clear();
+    for (auto& r : e.reps) {
+        reps[Coordinate(r.first.line + ps.begin.line, r.first.pos)] = r.second;
+    }
+    make_replacement(ps.program, reps, out);
+    reps.clear();
+    return true;
+}
+
+void Context::to_cache(uint64_t key, const ProgramString& ps, const std::map<std::string, uint64_t>& before, Record& rec) {
+    CacheEntry e;
+    if (set_origins(key, rec)) rec.opaque = true;   //блоки, определяющие функции, выполняются всегда
+    for (auto& r : rec.reads) e.reads.emplace_back(r.first, r.second);
+    for (auto& name : rec.defs) {
+        auto it = global.find(name);
+        if (it != global.end() && it->second._type != Value::FUNCTION) e.defs.emplace_back(name, it->second);
+    }
+    for (auto& it : idents) {
+        auto old = before.find(it.first);
+        uint64_t h = value_hash(it.first, it.second);
+        if (old == before.end() || old->second != h) e.idents.emplace_back(it.first, it.second);
+    }
+    for (auto& it : reps) {
+        if (it.second.replacement._type == Value::FUNCTION) rec.opaque = true;
+        e.reps.emplace_back(Coordinate(it.first.line - ps.begin.line, it.first.pos), it.second);
+    }
+
+    if (rec.opaque) cache->uncacheable();
+    else cache->store(key, std::move(e));
+}
+
+Value Context::eval(Node n) {
+    if (vm) return Vm::run(*this, n, nullptr);
+    return n.exec(*this, nullptr);
+}
+
+const Value &Context::lookup(const std::string& name, Frame *ptr, const Coordinate& pos) {
+    if (ptr) {
+        auto res = ptr->vars.find(name);
+        if (res != ptr->vars.end()) {
+            return res->second;
+        }
+        auto cap = ptr->env->find(name);
+        if (cap != ptr->env->end()) {
+            return cap->second;
+        }
+    }
+    auto res = global.find(name);
+    if (res != global.end()) {
+        if (record_) note_read(name, res->second);
+        return res->second;
+    }
+    throw Error(pos, "Undefined variable reference");
+}
+
+void Context::def(const std::string& name, Value val, Frame *ptr) {
+//    std::cout << "def is invoked for name = " << name << "\n";
+    target(name, ptr) = std::move(val);
+}
+
+Value &Context::target(const std::string& name, Frame *ptr) {
+    if (ptr) {
+        auto res = global.find(name);
+        if (res == global.end()) {
+            return ptr->vars[name];
+        }
+    }
+    if (record_) record_->defs.insert(name);
+    return global[name];
+}
+
+Value &Context::change(const std::string& name, Frame *ptr, const Coordinate& pos) {
+    if (ptr) {
+        auto res = ptr->vars.find(name);
+        if (res != ptr->vars.end()) {
+            return res->second;
+        }
+        auto cap = ptr->env->find(name);
+        if (cap != ptr->env->end()) {
+            return ptr->vars[name] = cap->second;
+        }
+    }
+    auto res = global.find(name);
+    if (res != global.end()) {
+        if (record_) {
+            note_read(name, res->second);
+            record_->defs.insert(name);
+        }
+        return res->second;
+    }
+    throw Error(pos, "Undefined variable reference");
+}
+
+Value &Context::counter(const std::string& name, Frame *ptr) {
+    if (ptr) {
+        return ptr->vars[name];
+    }
+    return target(name, ptr);
+}
+
+void Context::capture(Node body, const std::vector<std::string>& args, Frame *ptr, name_table& env) {
+    if (!body) return;
+    Tag t = body.get_tag();
+    if (t == IDENT || t == FUNC || t == GRAPHIC) {
+        const std::string& name = body.get_label();
+        if (!env.count(name) && std::find(args.begin(), args.end(), name) == args.end()) {
+            const Value *v = nullptr;
+            if (ptr) {  //в функции видны ее кадр и окружение, глобальные имена ищутся при вызове
+                auto res = ptr->vars.find(name);
+                auto cap = ptr->env->find(name);
+                if (res != ptr->vars.end()) v = &res->second;
+                else if (cap != ptr->env->end()) v = &cap->second;
+            } else {
+                auto res = global.find(name);
+                if (res != global.end()) v = &res->second;
+            }
+            if (v) env.emplace(name, *v);
+            if (record_) {
+                auto res = global.find(name);
+                if (res != global.end()) note_read(name, res->second);
+            }
+        }
+    }
+    capture(body.left(), args, ptr, env);
+    capture(body.right(), args, ptr, env);
+    capture(body.cond(), args, ptr, env);
+    for (auto field : body.fields()) capture(field, args, ptr, env);
+}
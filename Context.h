@@ -0,0 +1,102 @@
+#pragma once
+
+#include <exception>
+#include <map>
+#include <memory>
+#include <set>
+#include <string>
+#include <vector>
+#include <utility>
+
+#include "Coordinate.h"
+#include "OutputBuffer.h"
+#include "Node.h"
+#include "Value.h"
+
+
+class Cache;
+
+//обращения вычисления к глобальным именам; по ним кэш и режим наблюдения решают, нужно ли вычислять заново
+typedef struct Record {
+    std::map<std::string, uint64_t> reads;  //имя - хэш значения до первого изменения
+    std::set<std::string> defs;
+    bool opaque = false;                    //прочитано значение, которое нельзя хэшировать
+    bool defs_only = false;                 //чтения не записывать: нужен только список определений
+} Record;
+
+//результат лексера и парсера для блока: от других блоков не зависит, поэтому строится в любом потоке.
+//Ошибка сохраняется и выбрасывается, когда до блока дойдет выполнение, чтобы ошибки шли в порядке документа
+typedef struct Parsed {
+    Ast ast;                                //дерево блока, освобождается целиком после вывода замен
+    Node root;
+    std::vector<replacement_map> reps;      //места замен каждого оператора root
+    std::exception_ptr error;
+} Parsed;
+
+void parse_block(const ProgramString& ps, Parsed& res);
+
+//состояние обработки одного документа: глобальные имена, замены текущего блока и таблицы анализа.
+//Статических данных у интерпретатора нет, поэтому независимые контексты работают в разных потоках без блокировок
+class Context {
+public:
+    name_table global;          //имена, определенные на верхнем уровне блоков документа
+    replacement_map reps;       //замены текущего блока
+
+    //глобальные имена и функции, найденные семантическим анализом
+    name_table idents;
+    name_table funcs;
+    std::map<std::string, std::pair<Node, std::vector<std::pair<std::string, Value>>>> funcs_body;
+
+    Cache *cache = nullptr;                     //кэш результатов блоков между запусками, если включен
+    bool vm = false;                            //выполнять байт-код Vm, а не обходить дерево
+    std::map<std::string, uint64_t> origins;    //функции не сериализуются, их хэш - хэш вычисления определившего блока
+
+    void run(const ProgramString& ps, OutputBuffer& out);  //обработать блок и дописать его в out
+
+    void run(const ProgramString& ps, Parsed& parsed, OutputBuffer& out);  //то же для уже разобранного блока
+
+    Value eval(Node n);     //выполнить оператор верхнего уровня выбранным вычислителем
+
+    const Value &lookup(const std::string& name, Frame *ptr, const Coordinate&);
+
+    void def(const std::string& name, Value, Frame *ptr);
+
+    Value &target(const std::string& name, Frame *ptr);     //ячейка, в которую def запишет имя
+
+    //ячейка для изменения элемента матрицы на месте: имя из окружения функции
+    //сначала копируется в кадр, окружение общее для всех вызовов
+    Value &change(const std::string& name, Frame *ptr, const Coordinate&);
+
+    //ячейка счетчика \sum и \prod: в функции - имя кадра, даже если есть глобальное с тем же именем,
+    //чтобы тело цикла читало тот же счетчик, в который он пишется; на верхнем уровне - глобальное имя
+    Value &counter(const std::string& name, Frame *ptr);
+
+    //окружение новой функции: имена ее тела, видимые при определении (в кадре ptr или глобальные).
+    //Копируются только они, а не вся таблица, поэтому определение не дорожает с числом глобальных имен
+    void capture(Node body, const std::vector<std::string>& args, Frame *ptr, name_table& env);
+
+    void record(Record *r);     //записывать обращения в r; nullptr - не записывать
+
+    uint64_t value_hash(const std::string& name, const Value& v);
+
+    //хэш вычисления seed с прочитанными значениями становится происхождением определенных им функций
+    bool set_origins(uint64_t seed, const Record& r);
+
+private:
+    Record *record_ = nullptr;
+
+    void note_read(const std::string& name, const Value& v);
+
+    bool cached(const ProgramString& ps, OutputBuffer& out, uint64_t& key);
+
+    void execute(const ProgramString& ps, Parsed& parsed, OutputBuffer& out, uint64_t key);
+
+    bool from_cache(uint64_t key, const ProgramString& ps, OutputBuffer& out);
+
+    void to_cache(uint64_t key, const ProgramString& ps, const std::map<std::string, uint64_t>& before, Record& rec);
+};
+
+
+void make_replacement(std::string_view prog, const replacement_map& m, OutputBuffer& out);
+
+void make_replacement(std::string_view prog, const std::vector<replacement_map>& reps, OutputBuffer& out);
@@ -1,7 +1,9 @@
+#include <algorithm>
 #include <string>
 #include <iostream>
 #include <utility>
 #include "Coordinate.h"
+#include "Scanner.h"
 
 
 Coordinate::Coordinate(size_t l, size_t p) : line(l), pos(p) {}
@@ -36,23 +38,13 @@ bool Coordinate::operator<(const Coordinate &other) const {
 }
 
 
-Position::Position(const Position &p) : start(p.start), index(p.index) {}
-
-Position::Position(const Coordinate& x, size_t i) : start(x), index(i) {
-    if (ps.end < start) {
+Position::Position(const ProgramString *p, size_t i) : index(i), ps(p) {
+    if (ps && ps->stop < index) {
         std::cout << "Position:: ps.end < start\n";
         throw std::exception();
     }
 }
 
-Position& Position::operator=(const Position &p) {
-    if (&p != this) {
-        start = p.start;
-        index = p.index;
-    }
-    return *this;
-}
-
 Position Position::operator++(int) {
     Position tmp(*this);
     operator++();
@@ -60,23 +52,19 @@ Position Position::operator++(int) {
 }
 
 char Position::operator[](int i) const {
-    return ps.program[i];
-}
-
-char& Position::operator[](int i) {
-    return ps.program[i];
+    return ps->program[i];
 }
 
 char Position::cur() {
-    return ps.program[index];
+    return (index < ps->length) ? ps->program[index] : '\0';   //за концом view читать нельзя
 }
 
 bool Position::can_peek(int i) {
-    return index + i < ps.length;
+    return index + i < ps->length;
 }
 
 char Position::peek(int i) {
-    return ps.program[index + i];
+    return (index + i < ps->length) ? ps->program[index + i] : '\0';
 }
 
 char Position::get() {
@@ -86,20 +74,20 @@ char Position::get() {
 }
 
 bool Position::operator<(const Position &p) const {
-    return start < p.start;
+    return index < p.index;
 }
 
 bool Position::operator==(const Position &p) const {
-    return start == p.start;
+    return index == p.index;
 }
 
 bool Position::end_of_program() const {
-    return start == ps.end;
+    return index >= ps->stop;
 }
 
 int Position::is_at_newline() {
     if (cur() == '\n') return cur_type::NLINE;
-    if (index + 1 < ps.length &&
+    if (index + 1 < ps->length &&
         cur() == '\r' && peek() == '\n') {
         return cur_type::WNLINE;
     }
@@ -107,44 +95,17 @@ int Position::is_at_newline() {
 }
 
 Position &Position::operator++() {
-    if (!end_of_program()) {
-        int at_newline = is_at_newline();
-        if (at_newline == CHAR) {
-            start.inc_pos();
-            ++index;
-        } else {
-            start.inc_line();
-            index += at_newline;
-        }
-    }
-
+    if (!end_of_program()) ++index;     //"\r\n" проходится за два шага
     return *this;
 }
 
 
-Token::Token(const Token &t) : start(t.start), end(t.end), raw(t.raw), _ident(t._ident), _tag(t._tag) {}
-
-Token::Token(const Position& s, const Position& e, Tag t, std::string r)
-        : start(s), end(e), _tag(t), raw(std::move(r)) {
-    _ident = t_info[_tag].name;
-}
-
-Token& Token::operator=(const Token &t) {
-    if (&t != this) {
-        start = t.start;
-        end = t.end;
-        raw = t.raw;
-        _ident = t._ident;
-        _tag = t._tag;
-    }
-    return *this;
-}
+static_assert(sizeof(Token) == 16, "Token must stay compact");
 
 void Token::convert() {
     Tag alt = t_info[_tag].alternative_tag;
     if (alt) {
         _tag = alt;
-        _ident = t_info[_tag].name;
     }
 }
 
@@ -165,21 +126,43 @@ bool Token::operator==(const Token &t) const {
 }
 
 
+void Tokens::reset(const ProgramString& ps) {
+    pool.clear();
+    program = ps.program;
+    begin = ps.begin;
+    lines.assign(1, 0);
+    Scanner s;
+    s.reset(program.data(), program.size());
+    s.line_starts(0, program.size(), lines);
+}
+
+std::string_view Tokens::text(const Token& t) const {
+    if (t.flags & Token::POOLED) return pool[t.text];
+    return program.substr(t.start, t.end - t.start);
+}
+
+Coordinate Tokens::coord(uint32_t offset) const {
+    //разбор начинается на первой строке блока, поэтому ее начало - смещение 0
+    size_t k = std::upper_bound(lines.begin(), lines.end(), offset) - lines.begin() - 1;
+    return {begin.line + k, offset - lines[k] + 1};
+}
+
+
 std::string to_string(const Coordinate& c) {
     return "(" + std::to_string(c.line) + ", " + std::to_string(c.pos) + ")";
 }
 
 std::string to_string(const ProgramString& ps) {
     return "ProgramString " + to_string(ps.begin) + "-" + to_string(ps.end) +
-           " (" + std::to_string(ps.length) + ")\n" + ps.program;
+           " (" + std::to_string(ps.length) + ")\n" + std::string(ps.program);
 }
 
 std::string to_string(const Position& p) {
-    return "{" + to_string(p.start) + ", " + std::to_string(p.index) + "}";
+    return "{" + std::to_string(p.index) + "}";
 }
 
-std::string to_string(const Token& l) {
-    std::string res = "<" + to_string(l.start) + "-" + to_string(l.end) +
-                      ": " + ((l.raw.empty()) ? "" : (l.raw + "; ")) + l._ident + ">";
+std::string to_string(const Token& l, const Tokens& ts) {
+    std::string res = "<" + to_string(ts.coord(l.start)) + "-" + to_string(ts.coord(l.end)) +
+                      ": " + std::string(ts.text(l)) + "; " + t_info[l._tag].name + ">";
     return res;
 }
\ No newline at end of file
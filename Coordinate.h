@@ -1,8 +1,11 @@
 #pragma once
 
+#include <cstdint>
 #include <string>
+#include <string_view>
 #include <iostream>
 #include <utility>
+#include <vector>
 #include "Defines.h"
 
 
@@ -27,25 +30,23 @@ typedef struct Coordinate {
 } Coordinate;
 
 typedef struct ProgramString {
-    std::string program;
+    std::string_view program;   //текст блока без копирования (view в отображение входного файла)
+    size_t offset = 0;          //смещение блока от начала входного файла
     Coordinate begin;
     Coordinate end;
     size_t length = 0;
+    size_t stop = 0;            //смещение \end{preproc} от начала блока
 } ProgramString;
 
+//позиция лексера - только смещение в блоке, строка и столбец при необходимости берутся из таблицы строк Tokens
 typedef struct Position {
-    Coordinate start;
     size_t index;
-    static ProgramString ps;
+    const ProgramString *ps;    //блок, по которому движется позиция
     enum cur_type {
         CHAR, NLINE, WNLINE
     };
 
-    Position(const Position &p);
-
-    Position(const Coordinate& = Coordinate(), size_t = 0);
-
-    Position &operator=(const Position &p);
+    Position(const ProgramString* = nullptr, size_t = 0);
 
     int is_at_newline();
 
@@ -55,8 +56,6 @@ typedef struct Position {
 
     char operator[](int i) const;
 
-    char &operator[](int i);
-
     char cur();
 
     bool can_peek(int = 1);
@@ -75,18 +74,20 @@ typedef struct Position {
 } Position;
 
 
+//16 байт: смещения начала и конца в блоке, тег и флаги. Текст токена - подстрока блока,
+//а если его в блоке нет (имена аккумуляторов \sum, \floor), то строка пула Tokens
 typedef struct Token {
-    Position start; //координаты начала и конца
-    Position end;
-    std::string raw;    //подстрока из файла
-    std::string _ident;    //строковое представление тега - для принта
-    Tag _tag = ERROR;
-
-    Token(const Token &t);
-
-    Token(const Position&, const Position&, Tag = ERROR, std::string = "");
+    uint32_t start;     //смещения начала и конца в блоке
+    uint32_t end;
+    uint32_t text;      //номер строки в пуле, если установлен POOLED
+    Tag _tag : 8;
+    uint8_t flags;
+
+    enum flag {
+        POOLED = 1
+    };
 
-    Token &operator=(const Token &t);
+    Token(uint32_t s = 0, uint32_t e = 0, Tag t = ERROR) : start(s), end(e), text(0), _tag(t), flags(0) {}
 
     void convert();
 
@@ -97,10 +98,22 @@ typedef struct Token {
     bool operator<(const Token &t) const;
 
     bool operator==(const Token &t) const;
-
-    friend std::string to_string(const Position& p);
 } Token;
 
+//все, что нужно для текста и координат токенов блока; сами токены читаются из лексера по одному
+typedef struct Tokens {
+    std::vector<std::string> pool;      //тексты, которых нет в блоке
+    std::string_view program;           //текст блока
+    Coordinate begin;                   //координата начала разбора (после \begin{preproc})
+    std::vector<uint32_t> lines;        //смещения начал строк блока
+
+    void reset(const ProgramString& ps);
+
+    std::string_view text(const Token& t) const;
+
+    Coordinate coord(uint32_t offset) const;   //строка и столбец вычисляются только по запросу
+} Tokens;
+
 
 std::string to_string(const Coordinate& c);
 
@@ -108,4 +121,4 @@ std::string to_string(const ProgramString& ps);
 
 std::string to_string(const Position& p);
 
-std::string to_string(const Token& l);
\ No newline at end of file
+std::string to_string(const Token& l, const Tokens& ts);
\ No newline at end of file
@@ -6,26 +6,22 @@
 #include "Defines.h"
 
 
-Tag_info::Tag_info(
-    std::string n,
-    int p,
-    Tag ct,
-    Tag at,
-    bool op,
-    bool bin,
-    bool inv
-) :
-name(std::move(n)),
-priority(p),
-close_tag(ct),
-alternative_tag(at),
-is_operator(op),
-is_binary(bin),
-is_inverted(inv)
-{}
-
-
-std::map<Tag, Tag_info> t_info = {
+//как у std::map со списком инициализации: из повторов тега действует первый, у пропущенных тегов - Tag_info()
+template<size_t K>
+static constexpr std::array<Tag_info, tag_count> tag_table(const std::pair<Tag, Tag_info> (&list)[K]) {
+    std::array<Tag_info, tag_count> res{};
+    bool seen[tag_count] = {};
+    for (size_t i = 0; i < K; ++i) {
+        if (!seen[list[i].first]) {
+            seen[list[i].first] = true;
+            res[list[i].first] = list[i].second;
+        }
+    }
+    return res;
+}
+
+
+constexpr std::array<Tag_info, tag_count> t_info = tag_table({
 
         //простые элементы
         {NUMBER,      Tag_info("NUMBER", 0, NONE, NONE)},
@@ -104,10 +100,10 @@ std::map<Tag, Tag_info> t_info = {
         {SUM,         Tag_info("SUM", 0, NONE, NONE)},
         {PRODUCT,     Tag_info("PRODUCT", 0, NONE, NONE)},
         {DIMENSION, Tag_info("DIMENSION", 0, NONE, NONE)}
-};
+});
 
 
-std::map<std::string, enum Tag> raw_tag = {
+constexpr StaticMap<enum Tag, 29> raw_tag({
         {"\\\\",          Tag::BREAK},
         {"\\begin",       Tag::BEGIN},
         {"\\end",         Tag::END},
@@ -137,9 +133,9 @@ std::map<std::string, enum Tag> raw_tag = {
         {"\\abs",         Tag::ABS},
         {"\\floor",       Tag::FLOOR},
         {"\\ceil",       Tag::CEIL}
-};
+});
 
-std::map<std::string, enum Tag> dim_tag = {
+constexpr StaticMap<enum Tag, 7> dim_tag({
         {"m", Tag::DIMENSION},
         {"kg", Tag::DIMENSION},
         {"s", Tag::DIMENSION},
@@ -147,12 +143,12 @@ std::map<std::string, enum Tag> dim_tag = {
         {"K", Tag::DIMENSION},
         {"mol", Tag::DIMENSION},
         {"cd", Tag::DIMENSION},
-};
+});
 
 /**
  * m, kg, s, A, K, mol, cd
  */
-std::map<std::string, std::array<int, 7>> const dimensions = {
+constexpr StaticMap<std::array<int, 7>, 7> dimensions({
         //метры
         {"m",   {1, 0, 0, 0, 0, 0, 0}},
 
@@ -174,9 +170,9 @@ std::map<std::string, std::array<int, 7>> const dimensions = {
         //канделы
         {"cd",  {0, 0, 0, 0, 0, 0, 1}},
 
-};
+});
 
-std::map<std::string, int> arg_count = {
+constexpr StaticMap<int, 13> arg_count({
         {"\\cos",    1},
         {"\\sin",    1},
         {"\\tan",    1},
@@ -198,16 +194,16 @@ std::map<std::string, int> arg_count = {
         //  { "\\csc", 1 },
         {"\\floor",  1},
         {"\\ceil",  1}
-};
+});
 
-std::map<std::string, double> constants = {
+constexpr StaticMap<double, 4> constants({
         {"\\true",  1},
         {"\\false", 0},
         {"\\pi",    3.14159265358979323846},
-        {"\\exp",   exp(1)}
-};
+        {"\\exp",   2.71828182845904523536}
+});
 
-std::map<std::string, double (*)(double)> funcs1 = {
+constexpr StaticMap<double (*)(double), 13> funcs1({
         {"\\cos",    cos},
         {"\\sin",    sin},
         {"\\tan",    tan},
@@ -227,6 +223,6 @@ std::map<std::string, double (*)(double)> funcs1 = {
         //  { "\\csc", 1 },
         {"\\floor",  floor},
         {"\\ceil",  ceil}
-};
+});
 
 std::map<std::string, double (*)(double, double)> funcs2 = {};
@@ -7,6 +7,8 @@
 #include <vector>
 #include <array>
 
+#include "StaticMap.h"
+
 
 enum Tag {
     NONE = 0,
@@ -24,8 +26,10 @@ enum Tag {
     GRAPHIC, RANGE, TRANSP, SUM, PRODUCT, DIMENSION, SKIP, ABS, FLOOR, CEIL
 };
 
+constexpr size_t tag_count = CEIL + 1;
+
 typedef struct Tag_info {
-    std::string name = "NONE";
+    const char *name = "NONE";
     int priority = 0;
     Tag close_tag = NONE;
     Tag alternative_tag = NONE;
@@ -33,33 +37,42 @@ typedef struct Tag_info {
     bool is_binary = false;
     bool is_inverted = false;
 
-    explicit Tag_info(
-        std::string = "NONE",
-        int = 0,
-        Tag = NONE,
-        Tag = NONE,
-        bool = false,
-        bool = false,
-        bool = false
-    );
+    constexpr Tag_info(
+        const char *n = "NONE",
+        int p = 0,
+        Tag ct = NONE,
+        Tag at = NONE,
+        bool op = false,
+        bool bin = false,
+        bool inv = false
+    ) :
+    name(n),
+    priority(p),
+    close_tag(ct),
+    alternative_tag(at),
+    is_operator(op),
+    is_binary(bin),
+    is_inverted(inv)
+    {}
 } Tag_info;
 
 
-extern std::map<Tag, Tag_info> t_info ;
+//все таблицы строятся при компиляции: у тега - элемент массива, у строки - совершенный хеш
+extern const std::array<Tag_info, tag_count> t_info;
 
-extern std::map<std::string, enum Tag> raw_tag;
+extern const StaticMap<enum Tag, 29> raw_tag;
 
-extern std::map<std::string, enum Tag> dim_tag;
+extern const StaticMap<enum Tag, 7> dim_tag;
 
 /**
  * m, kg, s, A, K, mol, cd
  */
-extern std::map<std::string, std::array<int, 7>> const dimensions;
+extern const StaticMap<std::array<int, 7>, 7> dimensions;
 
-extern std::map<std::string, int> arg_count;
+extern const StaticMap<int, 13> arg_count;
 
-extern std::map<std::string, double> constants;
+extern const StaticMap<double, 4> constants;
 
-extern std::map<std::string, double (*)(double)> funcs1;
+extern const StaticMap<double (*)(double), 13> funcs1;
 
 extern std::map<std::string, double (*)(double, double)> funcs2;
@@ -0,0 +1,82 @@
+#include "DenseMatrix.h"
+
+
+DenseMatrix::DenseMatrix(size_t r, size_t c, const std::array<int, 7> &d) : rows(r), cols(c), dim(d), data(r * c) {}
+
+void DenseMatrix::add(const DenseMatrix &r) {
+    double *a = data.data();
+    const double *b = r.data.data();
+    size_t n = data.size();
+    for (size_t k = 0; k < n; ++k) {
+        a[k] = a[k] + b[k];
+    }
+}
+
+void DenseMatrix::sub(const DenseMatrix &r) {
+    double *a = data.data();
+    const double *b = r.data.data();
+    size_t n = data.size();
+    for (size_t k = 0; k < n; ++k) {
+        a[k] = a[k] - b[k];
+    }
+}
+
+void DenseMatrix::scale(double k) {
+    double *a = data.data();
+    size_t n = data.size();
+    for (size_t i = 0; i < n; ++i) {
+        a[i] = k * a[i];
+    }
+}
+
+void DenseMatrix::negate() {
+    double *a = data.data();
+    size_t n = data.size();
+    for (size_t i = 0; i < n; ++i) {
+        a[i] = -a[i];
+    }
+}
+
+DenseMatrix DenseMatrix::mul(const DenseMatrix &r) const {
+    std::array<int, 7> d{};
+    for (int k = 0; k < 7; ++k) {
+        d[k] = dim[k] + r.dim[k];
+    }
+    DenseMatrix res(rows, r.cols, d);
+    //строка результата накапливается по k: каждый элемент суммируется в том же порядке, что и в Value::mul,
+    //а внутренний цикл идет подряд по строкам res и r
+    for (size_t i = 0; i < rows; ++i) {
+        double *c = res.data.data() + i * res.cols;
+        const double *l = data.data() + i * cols;
+        const double *b = r.data.data();
+        for (size_t j = 0; j < r.cols; ++j) {
+            c[j] = l[0] * b[j];
+        }
+        for (size_t k = 1; k < cols; ++k) {
+            b = r.data.data() + k * r.cols;
+            double x = l[k];
+            for (size_t j = 0; j < r.cols; ++j) {
+                c[j] = c[j] + x * b[j];
+            }
+        }
+    }
+    return res;
+}
+
+DenseMatrix DenseMatrix::transpose() const {
+    DenseMatrix res(cols, rows, dim);
+    for (size_t i = 0; i < rows; ++i) {
+        for (size_t j = 0; j < cols; ++j) {
+            res.at(j, i) = at(i, j);
+        }
+    }
+    return res;
+}
+
+bool DenseMatrix::equal(const DenseMatrix &r) const {
+    size_t n = data.size();
+    for (size_t k = 0; k < n; ++k) {
+        if (!(data[k] == r.data[k])) return false;
+    }
+    return true;
+}
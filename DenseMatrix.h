@@ -0,0 +1,65 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <new>
+#include <vector>
+
+
+//память, выровненная по строке кэша: буфер матрицы читается векторными командами без невыровненных хвостов
+template<typename T>
+struct AlignedAllocator {
+    typedef T value_type;
+    static constexpr size_t alignment = 64;
+
+    AlignedAllocator() = default;
+
+    template<typename U>
+    AlignedAllocator(const AlignedAllocator<U>&) {}
+
+    T *allocate(size_t n) {
+        return static_cast<T *>(::operator new(n * sizeof(T), std::align_val_t(alignment)));
+    }
+
+    void deallocate(T *p, size_t) {
+        ::operator delete(p, std::align_val_t(alignment));
+    }
+
+    template<typename U>
+    bool operator==(const AlignedAllocator<U>&) const { return true; }
+
+    template<typename U>
+    bool operator!=(const AlignedAllocator<U>&) const { return false; }
+};
+
+//матрица чисел одной размерности: элементы подряд по строкам в одном буфере, без Value на каждое число.
+//Операции - простые циклы по буферу в том же порядке, что и поэлементные операции Value,
+//поэтому результаты совпадают до бита, а компилятор может их векторизовать
+typedef struct DenseMatrix {
+    size_t rows = 0;
+    size_t cols = 0;
+    std::array<int, 7> dim{};   //размерность всех элементов
+    std::vector<double, AlignedAllocator<double>> data;     //rows * cols чисел по строкам
+
+    DenseMatrix() = default;
+
+    DenseMatrix(size_t r, size_t c, const std::array<int, 7> &d);
+
+    double &at(size_t i, size_t j) { return data[i * cols + j]; }
+
+    double at(size_t i, size_t j) const { return data[i * cols + j]; }
+
+    void add(const DenseMatrix &r);     //поэлементно, размеры уже проверены
+
+    void sub(const DenseMatrix &r);
+
+    void scale(double k);   //k * x для каждого элемента
+
+    void negate();
+
+    DenseMatrix mul(const DenseMatrix &r) const;    //строки на столбцы, cols == r.rows
+
+    DenseMatrix transpose() const;
+
+    bool equal(const DenseMatrix &r) const;     //сравниваются только числа, как в Value::eq
+} DenseMatrix;
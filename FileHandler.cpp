@@ -1,15 +1,28 @@
 #include <fstream>
 #include <cstring>
+#include <fcntl.h>
+#include <unistd.h>
 
 #include "FileHandler.h"
 
 
-void FileHandler::print_to_out(const std::string& r) {
-    out_ << r; //печать в выходной файл
+OutputBuffer& FileHandler::out() {
+    if (buf_.segments() >= 1024) flush();   //не копить сегменты всего файла
+    return buf_;
+}
+
+void FileHandler::flush() {
+    if (out_ < 0 || failed_) return;
+    if (!buf_.write_to(out_)) {
+        std::cerr << "Couldn't write file: " << fout_ << std::endl;
+        failed_ = true;
+    }
 }
 
 int FileHandler::replace_files() {   //замена исходного файла выходным
+    flush();
     close();
+    if (failed_) return 1;
     if (!std::remove(fin_)) {
         if (std::rename(fout_, fin_)) std::cerr << "Couldn't rename file: " << fout_ << " to " << fin_ << std::endl;
         else return 0;
@@ -18,7 +31,19 @@ int FileHandler::replace_files() {   //замена исходного файл
     return 1;
 }
 
+int FileHandler::rename_out(const char *path) {
+    flush();
+    close();
+    if (failed_) return 1;
+    if (std::rename(fout_, path)) {
+        std::cerr << "Couldn't rename file: " << fout_ << " to " << path << std::endl;
+        return 1;
+    }
+    return 0;
+}
+
 int FileHandler::remove_out() {      //удаление выходного файла
+    buf_.clear();
     close();
     if (std::remove(fout_)) {
         std::cerr << "Couldn't remove file: " << fin_ << std::endl;
@@ -28,17 +53,21 @@ int FileHandler::remove_out() {      //удаление выходного фа
 }
 
 bool FileHandler::good() {
-    return in_.good() && out_.good();
+    return in_.good() && out_ >= 0 && !failed_;
 }
 
 void FileHandler::close() {
-    if (in_.is_open()) in_.close();
-    if (out_.is_open()) out_.close();
+    flush();    //сегменты ссылаются на отображение входного файла, писать до munmap
+    if (out_ >= 0) ::close(out_);
+    out_ = -1;
+    in_.close();
 }
 
-FileHandler::FileHandler(const char *fin, const char *fout) : line_(0), fin_(fin), fout_(fout) {
+FileHandler::FileHandler(const char *fin, const char *fout) :
+fin_(fin), fout_(fout), out_(-1), failed_(false), line_(0), pos_(0), text_(0) {
     in_.open(fin_);
-    out_.open(fout_);
+    scan_.reset(in_.data(), in_.size());
+    out_ = ::open(fout_, O_WRONLY | O_CREAT | O_TRUNC, 0644);
 }
 
 FileHandler::~FileHandler() {
@@ -48,49 +77,91 @@ FileHandler::~FileHandler() {
 const char *FileHandler::begin_ = "\\begin{preproc}";
 const char *FileHandler::end_ = "\\end{preproc}";
 
+size_t FileHandler::line_end(size_t from) const {
+    const void *nl = std::memchr(in_.data() + from, '\n', in_.size() - from);
+    return nl ? static_cast<const char *>(nl) - in_.data() : in_.size();
+}
+
+size_t FileHandler::line_begin(size_t from, size_t to) const {
+    const void *nl = memrchr(in_.data() + from, '\n', to - from);
+    return nl ? static_cast<const char *>(nl) - in_.data() + 1 : from;
+}
+
+bool FileHandler::at(size_t pos, const char *s) const {
+    size_t len = std::strlen(s);
+    return pos + len <= in_.size() && !std::memcmp(in_.data() + pos, s, len);
+}
+
 ProgramString FileHandler::next() {
-    std::string tmp;
-    std::string program;
-    Coordinate c_begin(line_);
+    ProgramString ps = scan();
+    copy_to(ps);
+    return ps;
+}
+
+void FileHandler::copy_to(const ProgramString& ps) {
+    //строки вне \begin_{preproc}...\end_{preproc} попадают в вывод одним куском без копирования
+    if (ps.program.empty()) {
+        out().span(in_.view(text_, in_.size() - text_));
+        text_ = in_.size();
+        if (in_.size() > 0 && in_.data()[in_.size() - 1] != '\n') {
+            out().span("\n");   //построчное чтение завершало каждую строку, в том числе последнюю, переводом строки
+        }
+    } else {
+        out().span(in_.view(text_, ps.offset - text_));
+        text_ = ps.offset + ps.length;
+    }
+}
+
+ProgramString FileHandler::scan() {
+    const char *data = in_.data();
+    size_t size = in_.size();
     Coordinate c_end(line_);
     ProgramString ps;
 
-    while (std::getline(in_, tmp)) {
-        ++line_;
-        size_t comment = tmp.find('%');
-        size_t res = tmp.find(begin_);
-
-        //в строке есть подстрока \begin{preproc} и она находится до %, если % есть
-        if (res != std::string::npos && res < comment) {
-            c_begin = Coordinate{ line_, res + std::strlen(begin_) + 1 };
-            program += tmp + "\n";
+    //строки не перебираются: сканер выдает только '%' и возможные начала \begin, \end; '%' пропускает остаток строки
+    for (size_t q = scan_.find(pos_); q < size; q = scan_.find(q)) {
+        if (data[q] == '%') {
+            q = line_end(q);
+            continue;
+        }
+        if (!at(q, begin_)) {
+            ++q;
+            continue;
+        }
 
-            res = tmp.find(end_);    //если \end{preproc} на той же строке
-            if (res != std::string::npos && res < comment) {
-                c_end = Coordinate{ line_, res + 1 };
+        //\begin{preproc} до комментария; блок начинается с начала этой строки
+        size_t block = line_begin(pos_, q);
+        line_ += scan_.lines(pos_, block) + 1;
+        Coordinate c_begin{ line_, q - block + std::strlen(begin_) + 1 };
+
+        size_t eol = size;
+        size_t stop = 0;
+        for (size_t e = scan_.find(block); e < size; e = scan_.find(e)) {   //\end{preproc} может быть на той же строке
+            if (data[e] == '%') {
+                e = line_end(e);
+                continue;
             }
-            else {
-                while (std::getline(in_, tmp)) {
-                    ++line_;
-                    comment = tmp.find('%');
-                    res = tmp.find(end_);
-                    program += tmp + "\n";
-                    if (res != std::string::npos && res < comment) {
-                        c_end = Coordinate{ line_, res + 1 };
-                        break;
-                    }
-                }
+            if (!at(e, end_)) {
+                ++e;
+                continue;
             }
+            line_ += scan_.lines(block, e);
+            c_end = Coordinate{ line_, e - line_begin(block, e) + 1 };
+            stop = e - block;
+            eol = line_end(e);
             break;
         }
-        //строки вне \begin_{preproc}...\end_{preproc} можно сразу писать в файл
-        out_ << tmp << std::endl;
+        pos_ = (eol < size) ? eol + 1 : size;
+
+        ps.program = in_.view(block, pos_ - block);
+        ps.offset = block;
+        ps.begin = c_begin;
+        ps.end = c_end;
+        ps.length = ps.program.length();
+        ps.stop = stop;
+        return ps;
     }
 
-    ps.program = program;
-    ps.begin = c_begin;
-    ps.end = c_end;
-    ps.length = program.length();
-
+    pos_ = size;
     return ps;
 }
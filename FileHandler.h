@@ -4,21 +4,31 @@
 #include <cstring>
 
 #include "Coordinate.h"
+#include "MappedFile.h"
+#include "OutputBuffer.h"
+#include "Scanner.h"
 
 
 class FileHandler {
 public:
-    static FileHandler& Instance(const char *fin, const char *fout) {
-        static FileHandler fh(fin, fout);
-        return fh;
-    }
+    FileHandler(const char *fin, const char *fout);
 
-	ProgramString next();   //найти следующее окружение preproc
+    ~FileHandler();
 
-    void print_to_out(const std::string& r);
+	ProgramString next();   //найти следующее окружение preproc, текст блока - view в отображение файла
+
+	ProgramString scan();   //то же без вывода: блоки можно найти заранее, а текст между ними вывести позже
+
+	void copy_to(const ProgramString& ps);  //вывести текст перед блоком ps; пустой ps - до конца файла
+
+    OutputBuffer& out();    //сегменты выходного файла; пишутся в файл при закрытии
+
+    void flush();
 
     int replace_files();
 
+    int rename_out(const char *path);   //записать выходной файл и переименовать его в path
+
 	int remove_out();
 
 	bool good();
@@ -31,14 +41,21 @@ private:
 	static const char *end_;
 	const char *fin_;
 	const char *fout_;
-	std::ifstream in_;
-	std::ofstream out_;
+	MappedFile in_;
+	Scanner scan_;
+	int out_;
+	bool failed_;
+	OutputBuffer buf_;
 	size_t line_;
+	size_t pos_;    //смещение первого непрочитанного байта входного файла
+	size_t text_;   //начало текста, еще не переданного в вывод
 
-	void close();
+	size_t line_end(size_t from) const;
 
-	FileHandler(const char *fin, const char *fout);
+	size_t line_begin(size_t from, size_t to) const;   //начало строки, содержащей to; from - начало какой-то строки
 
-	~FileHandler();
+	bool at(size_t pos, const char *s) const;
+
+	void close();
 };
 
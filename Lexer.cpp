@@ -1,9 +1,40 @@
+#include <algorithm>
+#include <cstring>
 #include <vector>
 #include <string>
 
 #include "Lexer.h"
 
 
+//классы первого символа токена: по ним главный цикл выбирает ветку без цепочки isspace/isalpha/isdigit
+enum lead : uint8_t {
+    L_OTHER, L_SPACE, L_ALPHA, L_DIGIT, L_SLASH, L_PERCENT, L_SINGLE, L_SPECIAL
+};
+
+static constexpr struct Leads {
+    uint8_t cls[256];
+    Tag tag[256];           //тег односимвольного токена L_SINGLE
+
+    constexpr Leads() : cls(), tag() {
+        for (int c = 0; c < 256; ++c) {
+            tag[c] = ERROR;
+            if (c == ' ' || (c >= '\t' && c <= '\r')) cls[c] = L_SPACE;
+            else if ((c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z')) cls[c] = L_ALPHA;
+            else if (c >= '0' && c <= '9') cls[c] = L_DIGIT;
+        }
+        cls['\\'] = L_SLASH;
+        cls['%'] = L_PERCENT;
+        const char singles[] = "+-*/^(),[_<>=&";
+        const Tag tags[] = {ADD, SUB, MUL, DIV, POW, LPAREN, RPAREN, COMMA, LBRACKET, INDEX, LT, GT, EQ, AMP};
+        for (int i = 0; singles[i]; ++i) {
+            cls[uint8_t(singles[i])] = L_SINGLE;
+            tag[uint8_t(singles[i])] = tags[i];
+        }
+        cls['{'] = cls['}'] = cls[']'] = cls[':'] = L_SPECIAL;   //зависят от состояния лексера
+    }
+} leads;
+
+
 Lexer::Lexer() = default;;
 
 Lexer::Lexer(const Position& p, const ProgramString&) {
@@ -13,68 +44,87 @@ Lexer::Lexer(const Position& p, const ProgramString&) {
 Lexer::~Lexer() = default;
 
 
-std::vector<Token> Lexer::next() {
-    std::vector<Token> v;
-    if (!current.end_of_program()) {
-        Position start = current;
-        char c = current.get(); //сохранить текущий символ и перейти на следующий
-        std::string tmp;
-
-        if (c == '\n' && isProduct) {
-            if (product_iter_tokens.size() == product_tokens.size()) {
-                isProduct = false;
-                for (int i = product_tokens.size() - 1; i >= 0; i--) {
-                    v.push_back(product_iter_tokens[i]);
-                    v.emplace_back(start, current, SET);
-                    v.push_back(product_iter_tokens[i]);
-                    v.emplace_back(start, current, ADD);
-                    v.emplace_back(start, current, NUMBER, "1");
-                    v.push_back(product_tokens[i]);
-                    v.emplace_back(start, current, ENDB, "\\end");
-                    v.emplace_back(start, current, ENDB, "\\end");
-                }
-                return v;
-            } else {
-                std::cout << "iters != products";  // не должно выполняться
-            }
-        } else if (c == '\n' && isSum) {
-            if (sum_tokens.size() == sum_iter_tokens.size()) {
-                isSum = false;
-                for (int i = sum_tokens.size() - 1; i >= 0; i--) {
-//                    std::cout << "iter = " << i << std::endl;
-                    v.push_back(sum_iter_tokens[i]);
-                    v.emplace_back(start, current, SET);
-                    v.push_back(sum_iter_tokens[i]);
-                    v.emplace_back(start, current, ADD);
-                    v.emplace_back(start, current, NUMBER, "1");
-                    v.emplace_back(start, current, ENDB, "\\end");
-                    v.push_back(sum_tokens[i]);
-                    v.emplace_back(start, current, ENDB, "\\end");
-                }
-                return v;
-            } else {
-                std::cout << "iters != sums";  // не должно выполняться
+Token Lexer::make(const Position& s, const Position& e, Tag t, const std::string& raw) {
+    Token res(s.index, e.index, t);
+    //текст нужен только именам и числам; если он не совпадает с подстрокой блока, то хранится в пуле
+    if (t == NUMBER || t == IDENT || t == KEYWORD || t == DIMENSION) {
+        if (raw != out_->program.substr(s.index, e.index - s.index)) {
+            res.flags |= Token::POOLED;
+            res.text = out_->pool.size();
+            out_->pool.push_back(raw);
+        }
+    }
+    return res;
+}
+
+void Lexer::emit(const Position& s, const Position& e, Tag t, const std::string& raw) {
+    push(make(s, e, t, raw));
+}
+
+//токен, текст которого - ровно подстрока блока: пул не нужен
+void Lexer::span(const Position& s, const Position& e, Tag t) {
+    push(Token(s.index, e.index, t));
+}
+
+std::string_view Lexer::source(const Position& s, const Position& e) const {
+    return out_->program.substr(s.index, e.index - s.index);
+}
+
+//конец серии символов класса k от текущей позиции; дальше \end{preproc} серия не идет
+size_t Lexer::run(Scanner::run k) const {
+    return Scanner::skip(k, current.ps->program.data(), current.index, current.ps->stop);
+}
+
+void Lexer::push(const Token& t) {
+    ring_[tail_++ % RING] = t;
+}
+
+void Lexer::next() {
+    const char *p = current.ps->program.data();
+    const size_t stop = current.ps->stop;
+
+    //пробелы и комментарии пропускаются здесь же, токены для них не нужны
+    for (;;) {
+        if (current.index >= stop) {
+            span(current, current, NONE);
+            return;
+        }
+        char c = p[current.index];
+        uint8_t k = leads.cls[uint8_t(c)];
+        if (k == L_SPACE) {
+            ++current.index;
+            if (current.index < stop && leads.cls[uint8_t(p[current.index])] == L_SPACE) {    //чаще всего пробел один
+                current.index = Scanner::skip(Scanner::SPACES, p, current.index, stop);
             }
-        } else if (isspace(c)) {
-            while (isspace(current.cur())) current++;
-            v.emplace_back(start, current, SPACE);
-            return v;
-        } else if (c == '%') { //комментарии игнорируются до следующей строки
-            do { current++; } while (!current.is_at_newline());
-            v.emplace_back(start, current, SPACE);
-            return v;
-        } else if (c == '\\') {
+        } else if (k == L_PERCENT) {    //комментарии игнорируются до следующей строки
+            size_t from = std::min(current.index + 2, stop);    //символ после '%' пропускается всегда
+            auto nl = static_cast<const char *>(std::memchr(p + from, '\n', stop - from));
+            size_t e = nl ? nl - p : stop;
+            if (nl && e > from && p[e - 1] == '\r') --e;
+            current.index = e;
+        } else {
+            break;
+        }
+    }
+
+    Position start = current;
+    char c = p[current.index++]; //сохранить текущий символ и перейти на следующий
+    std::string tmp;
+
+    switch (leads.cls[uint8_t(c)]) {
+        case L_SLASH: {
             if (!current.end_of_program() && current.cur() == '\\') {
                 current++;
-                v.emplace_back(start, current, BREAK, "\\\\");
-                return v;
+                span(start, current, BREAK);
+                return;
             }
-            for (tmp = c; isalpha(current.cur());) tmp += current.get();
+            current.index = run(Scanner::LETTERS);
+            tmp = source(start, current);
 
             Tag tmp_tag = KEYWORD;
-            auto res = raw_tag.find(tmp);
-            if (res != raw_tag.end()) {
-                tmp_tag = res->second;
+            const Tag *res = raw_tag.find(tmp);
+            if (res) {
+                tmp_tag = *res;
                 std::string attrib;
                 if (tmp_tag == PLACEHOLDER) {
                     if (current.cur() == '[') {
@@ -84,294 +134,191 @@ std::vector<Token> Lexer::next() {
                         auto tmp_cur = current;
                         while (current.cur() != ']') current.get();
                         current.get();
-                        if (!get_attribute(attrib)) throw Error(current.start, "Expected {...}");
+                        if (!get_attribute(attrib)) throw Error(out_->coord(current.index), "Expected {...}");
 
-                        v.emplace_back(start, current, PLACEHOLDER, tmp);
-                        v.emplace_back(start, tmp_cur, DIV);
-                        v.emplace_back(start, tmp_cur, LPAREN);
+                        emit(start, current, PLACEHOLDER, tmp);
+                        emit(start, tmp_cur, DIV);
+                        emit(start, tmp_cur, LPAREN);
                         current = tmp_cur;
-                        return v;
+                        return;
                     } else {
-                        if (!get_attribute(attrib)) throw Error(current.start, "Expected {...}");
-                        v.emplace_back(start, current, PLACEHOLDER, tmp);
-                        return v;
+                        if (!get_attribute(attrib)) throw Error(out_->coord(current.index), "Expected {...}");
+                        emit(start, current, PLACEHOLDER, tmp);
+                        return;
                     }
                 }
                 if (tmp_tag == BEGIN || tmp_tag == END) {
-                    if (!get_attribute(attrib)) throw Error(current.start, "Expected {...}");
+                    if (!get_attribute(attrib)) throw Error(out_->coord(current.index), "Expected {...}");
                     switch (tmp_tag) {
                         case BEGIN:
                             if (attrib == "{block}") {
-                                v.emplace_back(start, current, BEGINB, tmp);
-                                return v;
+                                emit(start, current, BEGINB, tmp);
+                                return;
                             } else if (attrib == "{caseblock}") {
-                                v.emplace_back(start, current, BEGINC, tmp);
-                                return v;
+                                emit(start, current, BEGINC, tmp);
+                                return;
                             } else if (attrib == "{pmatrix}") {
-                                v.emplace_back(start, current, BEGINM, tmp);
-                                return v;
+                                emit(start, current, BEGINM, tmp);
+                                return;
                             }
                         case END:
                             if (attrib == "{block}") {
-                                v.emplace_back(start, current, ENDB, tmp);
-                                return v;
+                                emit(start, current, ENDB, tmp);
+                                return;
                             } else if (attrib == "{caseblock}") {
-                                v.emplace_back(start, current, ENDC, tmp);
-                                return v;
+                                emit(start, current, ENDC, tmp);
+                                return;
                             } else if (attrib == "{pmatrix}") {
-                                v.emplace_back(start, current, ENDM, tmp);
-                                return v;
+                                emit(start, current, ENDM, tmp);
+                                return;
                             }
                         default:
                             break;
                     }
-                } else if (tmp_tag == SUM) {
-                    current.get(); // прочитали _
-
-                    sumName = "sum" + std::to_string(random());
-
-                    v.emplace_back(start, current, BEGINB, "\\begin");
-
-                    v.emplace_back(start, current, IDENT, sumName);
-                    v.emplace_back(start, current, SET);
-                    v.emplace_back(start, current, NUMBER, "0");
-
-                    std::string lower_bound;
-                    if (!get_attribute(lower_bound)) throw Error(current.start, "Expected {...}");
-                    std::vector<Token> lower = parse_sum_lower_bound(lower_bound);
-
-                    current.get(); // прочитали ^
-
-                    std::string upper_bound;
-                    if (!get_attribute(upper_bound)) throw Error(current.start, "Expected {...}");
-                    std::vector<Token> upper = parse_sum_upper_bound(upper_bound);
-
-                    v.insert(v.end(), lower.begin(), lower.end());
-                    v.emplace_back(start, current, WHILE, "\\while");
-                    v.emplace_back(start, current, LBRACE);
-                    v.push_back(lower[0]);
-                    v.emplace_back(start, current, LEQ);
-                    v.push_back(upper[0]);
-                    v.emplace_back(start, current, RBRACE);
-                    v.emplace_back(start, current, BEGINB, "\\begin");
-
-                    v.emplace_back(start, current, IDENT, sumName);
-                    v.emplace_back(start, current, SET);
-                    v.emplace_back(start, current, IDENT, sumName);
-                    v.emplace_back(start, current, ADD);
-                    sum_tokens.emplace_back(start, current, IDENT, sumName);
-                    sum_iter_tokens.push_back(lower[0]);
-
-                    isSum = true;
-
-                    return v;
-                } else if (tmp_tag == PRODUCT) {
-                    isProduct = true;
-
-                    productName = "product" + std::to_string(random());
-
-                    current.get(); // прочитали _
-
-
-                    v.emplace_back(start, current, BEGINB, "\\begin");
-                    v.emplace_back(start, current, IDENT, productName);
-                    v.emplace_back(start, current, SET);
-                    v.emplace_back(start, current, NUMBER, "1");
-
-                    std::string lower_bound;
-                    if (!get_attribute(lower_bound)) throw Error(current.start, "Expected {...}");
-                    std::vector<Token> lower = parse_sum_lower_bound(lower_bound);
-
-                    current.get(); // read ^
-
-                    std::string upper_bound;
-                    if (!get_attribute(upper_bound)) throw Error(current.start, "Expected {...}");
-                    std::vector<Token> upper = parse_sum_upper_bound(upper_bound);
-
-                    v.insert(v.end(), lower.begin(), lower.end());
-                    v.emplace_back(start, current, PRODUCT, "\\product");
-                    //cond
-                    v.emplace_back(start, current, LBRACE);
-                    v.push_back(lower[0]);
-                    v.emplace_back(start, current, LEQ);
-                    v.push_back(upper[0]);
-                    v.emplace_back(start, current, RBRACE);
-
-                    v.emplace_back(start, current, BEGINB, "\\begin");
-                    v.emplace_back(start, current, IDENT, productName);
-                    v.emplace_back(start, current, SET);
-                    v.emplace_back(start, current, IDENT, productName);
-                    v.emplace_back(start, current, MUL);
-
-                    product_tokens.emplace_back(start, current, IDENT, productName);
-                    product_iter_tokens.push_back(lower[0]);
-
-                    return v;
                 } else if (tmp_tag == FLOOR) {
                     isFloor = true;
 
                     current.get(); //read *
                     if (current.get() == '{') {
-                        v.emplace_back(start, current, KEYWORD, "\\floor");
-                        v.emplace_back(start, current, LPAREN);
-                    } else throw Error(current.start, "Expected {...}");
+                        emit(start, current, KEYWORD, "\\floor");
+                        emit(start, current, LPAREN);
+                    } else throw Error(out_->coord(current.index), "Expected {...}");
 
-                    return v;
+                    return;
                 } else if (tmp_tag == CEIL) {
                     isCeil = true;
 
                     current.get(); //read *
                     if (current.get() == '{') {
-                        v.emplace_back(start, current, KEYWORD, "\\ceil");
-                        v.emplace_back(start, current, LPAREN);
-                    } else throw Error(current.start, "Expected {...}");
+                        emit(start, current, KEYWORD, "\\ceil");
+                        emit(start, current, LPAREN);
+                    } else throw Error(out_->coord(current.index), "Expected {...}");
 
-                    return v;
+                    return;
                 }
             }
-            v.emplace_back(start, current, tmp_tag, tmp);
-            return v;
-        } else if (isalpha(c)) {
-            for (tmp = c; isalpha(current.cur()) || isdigit(current.cur());) tmp += current.get();
-            auto res = dim_tag.find(tmp);
-
-            if (res != dim_tag.end()) {
-                v.emplace_back(start, current, DIMENSION, tmp);
-                return v;
+            span(start, current, tmp_tag);
+            return;
+        }
+        case L_ALPHA: {
+            current.index = run(Scanner::ALNUMS);
+
+            if (dim_tag.find(source(start, current))) {
+                span(start, current, DIMENSION);
+                return;
             } else if (current.can_peek() && current.cur() == '_' &&
                        current.peek() == '\\') {   //это не может быть индекс, потому что после '_' идет '\'
+                tmp = source(start, current);
                 tmp += current.get();   //прочитать '_'
                 std::string kw;
                 kw += current.get();
                 while (isalpha(current.cur())) { kw += current.get(); } //прочитать '\text'
-                if (kw != "\\text") throw Error(current.start, "Expected \\text{...}");
-                if (!get_attribute(kw)) throw Error(current.start, "Expected {...}");
+                if (kw != "\\text") throw Error(out_->coord(current.index), "Expected \\text{...}");
+                if (!get_attribute(kw)) throw Error(out_->coord(current.index), "Expected {...}");
                 tmp += kw;
+                emit(start, current, IDENT, tmp);   //текст не совпадает с блоком, если в {...} были пробелы или '\'
+                return;
             }
-            v.emplace_back(start, current, IDENT, tmp);
-            return v;
-        } else if (isdigit(c)) {
-            tmp = c;
-            if (c != '0') while (isdigit(current.cur())) tmp += current.get();
+            span(start, current, IDENT);
+            return;
+        }
+        case L_DIGIT:
+            if (c != '0') current.index = run(Scanner::DIGITS);
             if (!current.end_of_program() && current.cur() == '.') {
-                tmp += current.get();
-                while (isdigit(current.cur())) tmp += current.get();
+                current++;
+                current.index = run(Scanner::DIGITS);
             }
-            v.emplace_back(start, current, NUMBER, tmp);
-            return v;
-        } else {
-            switch (c) {
-                case '+':
-                    v.emplace_back(start, current, ADD);
-                    return v;
-                case '-':
-                    v.emplace_back(start, current, SUB);
-                    return v;
-                case '*':
-                    v.emplace_back(start, current, MUL);
-                    return v;
-                case '/':
-                    v.emplace_back(start, current, DIV);
-                    return v;
-                case '^':
-                    v.emplace_back(start, current, POW);
-                    return v;
-                case '(':
-                    v.emplace_back(start, current, LPAREN);
-                    return v;
-                case ')':
-                    v.emplace_back(start, current, RPAREN);
-                    return v;
-                case ',':
-                    v.emplace_back(start, current, COMMA);
-                    return v;
-                case '{':
-                    if (!isPlaceholder) {
-                        v.emplace_back(start, current, LBRACE);
-                    } else {
-                        v.emplace_back(current, current, SKIP);
-                    }
-                    return v;
-                case '}':
-                    if (!isPlaceholder && !isFloor && !isCeil) {
-                        v.emplace_back(start, current, RBRACE);
-                    } else {
-                        if (isPlaceholder) {
-                            isPlaceholder = false;
-                            v.emplace_back(current, current, SKIP);
-                        } else if (isFloor) {
-                            isFloor = false;
-                            v.emplace_back(start, current, RPAREN);
-                        } else {
-                            isCeil = false;
-                            v.emplace_back(start, current, RPAREN);
-                        }
-                    }
-                    return v;
-                case '[':
-                    v.emplace_back(start, current, LBRACKET);
-                    return v;
-                case ']':
-                    if (!isPlaceholder) {
-                        v.emplace_back(start, current, RBRACKET);
-                    } else {
-                        v.emplace_back(start, current, RPAREN);
-                    }
-                    return v;
-                case '_':
-                    v.emplace_back(start, current, INDEX);
-                    return v;
-                case '<':
-                    v.emplace_back(start, current, LT);
-                    return v;
-                case '>':
-                    v.emplace_back(start, current, GT);
-                    return v;
-                case '=':
-                    v.emplace_back(start, current, EQ);
-                    return v;
-                case '&':
-                    v.emplace_back(start, current, AMP);
-                    return v;
-                case ':':
-                    if (!current.end_of_program() && current.cur() == '=') {
-                        v.emplace_back(start, ++current, SET);
-                        return v;
-                    }
-                default:
-                    v.emplace_back(start, current);
-                    return v;
+            span(start, current, NUMBER);
+            return;
+        case L_SINGLE:
+            span(start, current, leads.tag[uint8_t(c)]);
+            return;
+        default:
+            break;
+    }
+
+    switch (c) {
+        case '{':
+            if (!isPlaceholder) {
+                span(start, current, LBRACE);
+            } else {
+                span(current, current, SKIP);
             }
-        }
+            return;
+        case '}':
+            if (!isPlaceholder && !isFloor && !isCeil) {
+                span(start, current, RBRACE);
+            } else {
+                if (isPlaceholder) {
+                    isPlaceholder = false;
+                    span(current, current, SKIP);
+                } else if (isFloor) {
+                    isFloor = false;
+                    span(start, current, RPAREN);
+                } else {
+                    isCeil = false;
+                    span(start, current, RPAREN);
+                }
+            }
+            return;
+        case ']':
+            if (!isPlaceholder) {
+                span(start, current, RBRACKET);
+            } else {
+                span(start, current, RPAREN);
+            }
+            return;
+        case ':':
+            if (!current.end_of_program() && current.cur() == '=') {
+                span(start, ++current, SET);
+                return;
+            }
+        default:
+            span(start, current);
+            return;
     }
-    v.emplace_back(current, current, NONE);
-    return v;
 }
 
-std::vector<Token> Lexer::program_to_tokens(const ProgramString& ps) {
-    std::vector<Token> res;
-    Position::ps = ps;
-    current = Position(ps.begin, ps.begin.pos - 1);
-    Tag t;
-    bool skip = false;
-    do {
-        std::vector<Token> x = next();
+void Lexer::open(const ProgramString& ps, Tokens& res) {
+    res.reset(ps);
+    out_ = &res;
+    current = Position(&ps, ps.begin.pos - 1);
+    tail_ = 0;
+    skip_ = false;
+}
+
+//следующая группа токенов для парсера: неизвестные окружения и пустые фигурные скобки \placeholder отбрасываются
+void Lexer::fill() {
+    for (;;) {
+        size_t first = tail_;
+        next();
+        if (tail_ == first) continue;
 
-        t = x[0]._tag;
+        const Token& t0 = ring_[first % RING];
+        Tag t = t0._tag;
         if (t == BEGIN) {
-            skip = true;
+            skip_ = true;
         }
-        if (!skip && t != SPACE && t != SKIP) {
-            if (t == ERROR) {
-                throw Error(x[0].start.start, "Unexpected symbol");
-            }
-            res.insert(res.end(), x.begin(), x.end());
+        if (t == NONE) {
+            return;     //конец блока отдается всегда, даже внутри незакрытого окружения
+        }
+        if (skip_ || t == SKIP) {
+            tail_ = first;
+        } else if (t == ERROR) {
+            throw Error(out_->coord(t0.start), "Unexpected symbol");
         }
         if (t == END) {
-            skip = false;
+            skip_ = false;
         }
-    } while (t != NONE);
-    return res;
+        if (tail_ != first) return;
+    }
+}
+
+Token *Lexer::at(size_t i) {
+    while (tail_ <= i) {
+        fill();
+    }
+    return &ring_[i % RING];
 }
 
 bool Lexer::get_attribute(std::string &s) {
@@ -387,89 +334,3 @@ bool Lexer::get_attribute(std::string &s) {
     } while (lb != rb && !current.end_of_program());
     return lb == rb;
 }
-
-std::vector<Token> Lexer::parse_sum_lower_bound(std::string s) {
-    Position start = current;
-    std::vector<Token> v;
-    int i = 1;
-    std::string ident;
-    std::string bound;
-
-    bool ident_not_found = true;
-    bool bound_not_found = true;
-
-    while (i < s.length() && (ident_not_found || bound_not_found)) {
-        if (isalpha(s[i])) {
-            while (isalpha(s[i])) {
-                ident += s[i];
-                i++;
-            }
-            ident_not_found = false;
-        } else if (isdigit(s[i])) {
-            bound = s[i];
-            if (s[i] != '0') {
-                i++;
-                while (isdigit(s[i])) {
-                    bound += s[i];
-                    i++;
-                }
-            }
-            if (s[i] == '.') {
-                bound += s[i];
-                i++;
-                while (isdigit(s[i])) {
-                    bound += s[i];
-                    i++;
-                }
-            }
-            bound_not_found = false;
-        }
-        i++;
-    }
-    v.emplace_back(start, current, IDENT, ident);
-    v.emplace_back(start, current, SET);
-    v.emplace_back(start, current, NUMBER, bound);
-
-    return v;
-}
-
-std::vector<Token> Lexer::parse_sum_upper_bound(std::string s) {
-    Position start = current;
-    std::vector<Token> v;
-    int i = 1;
-    std::string bound;
-
-    bool bound_not_found = true;
-
-    while (i < s.length() && bound_not_found) {
-        if (isdigit(s[i])) {
-            bound = s[i];
-            if (s[i] != '0') {
-                i++;
-                while (isdigit(s[i])) {
-                    bound += s[i];
-                    i++;
-                }
-            }
-            if (s[i] == '.') {
-                bound += s[i];
-                i++;
-                while (isdigit(s[i])) {
-                    bound += s[i];
-                    i++;
-                }
-            }
-            bound_not_found = false;
-            v.emplace_back(start, current, NUMBER, bound);
-        } else if (isalpha(s[i])) {
-            while (isalpha(s[i])) {
-                bound += s[i];
-                i++;
-            }
-            bound_not_found = false;
-            v.emplace_back(start, current, IDENT, bound);
-        }
-        i++;
-    }
-    return v;
-}
\ No newline at end of file
@@ -1,40 +1,48 @@
 #pragma once
 
 #include <vector>
-#include <random>
 #include <string>
 
 #include "Coordinate.h"
 #include "Defines.h"
 #include "Error.h"
+#include "Scanner.h"
 
 
+//лексер отдает токены по запросу парсера, весь блок в память не выкладывается
 class Lexer {
 private:
+    static const size_t RING = 64;      //группа одного вызова next() (не больше трех токенов) и токены парсера
+
     Position current;
+    Tokens *out_ = nullptr;     //пул текстов токенов текущего блока
 
-    bool get_attribute(std::string &);
+    Token ring_[RING];          //next() дописывает сюда группу токенов, парсер читает их по номеру
+    size_t tail_ = 0;           //сколько токенов записано
 
-    std::vector<Token> next();
+    bool skip_ = false;         //внутри неизвестного \begin{...} ... \end{...}
 
-    std::vector<Token> parse_sum_lower_bound(std::string s);
+    Token make(const Position& s, const Position& e, Tag t = ERROR, const std::string& raw = "");
 
-    std::vector<Token> parse_sum_upper_bound(std::string s);
+    void emit(const Position& s, const Position& e, Tag t = ERROR, const std::string& raw = "");
 
-    bool isSum = false;
-    bool isProduct = false;
-    bool isPlaceholder = false;
-    bool isFloor = false;
-    bool isCeil = false;
+    void span(const Position& s, const Position& e, Tag t = ERROR);
+
+    std::string_view source(const Position& s, const Position& e) const;
+
+    size_t run(Scanner::run k) const;
 
-    std::vector<Token> sum_tokens;
-    std::vector<Token> sum_iter_tokens;
+    void push(const Token& t);
 
-    std::vector<Token> product_tokens;
-    std::vector<Token> product_iter_tokens;
+    void fill();
 
-    std::string sumName;
-    std::string productName;
+    bool get_attribute(std::string &);
+
+    void next();
+
+    bool isPlaceholder = false;
+    bool isFloor = false;
+    bool isCeil = false;
 
 public:
     Lexer();
@@ -43,5 +51,7 @@ public:
 
     ~Lexer();
 
-    std::vector<Token> program_to_tokens(const ProgramString&);
+    void open(const ProgramString&, Tokens& res);   //тексты и строки блока пишутся в res
+
+    Token *at(size_t i);    //токен номер i; назад можно вернуться, пока кольцо не перезаписано (RING - 3 токена)
 };
\ No newline at end of file
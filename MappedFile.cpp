@@ -0,0 +1,69 @@
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "MappedFile.h"
+
+
+MappedFile::MappedFile() : data_(""), size_(0), mapped_(false), good_(false) {}
+
+MappedFile::MappedFile(const char *path) : MappedFile() {
+    open(path);
+}
+
+MappedFile::~MappedFile() {
+    close();
+}
+
+bool MappedFile::open(const char *path) {
+    close();
+    int fd = ::open(path, O_RDONLY);
+    if (fd < 0) return false;
+
+    struct stat st{};
+    if (fstat(fd, &st) || !S_ISREG(st.st_mode)) {
+        ::close(fd);
+        return false;
+    }
+
+    size_ = st.st_size;
+    if (size_ > 0) {    //пустой файл отобразить нельзя, но он корректен
+        void *p = mmap(nullptr, size_, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (p == MAP_FAILED) {
+            ::close(fd);
+            size_ = 0;
+            return false;
+        }
+        madvise(p, size_, MADV_SEQUENTIAL);
+        data_ = static_cast<const char *>(p);
+        mapped_ = true;
+    }
+    ::close(fd);    //отображение остается действительным и после закрытия дескриптора
+    good_ = true;
+    return true;
+}
+
+void MappedFile::close() {
+    if (mapped_) munmap(const_cast<char *>(data_), size_);
+    data_ = "";
+    size_ = 0;
+    mapped_ = false;
+    good_ = false;
+}
+
+bool MappedFile::good() const {
+    return good_;
+}
+
+const char *MappedFile::data() const {
+    return data_;
+}
+
+size_t MappedFile::size() const {
+    return size_;
+}
+
+std::string_view MappedFile::view(size_t offset, size_t length) const {
+    return {data_ + offset, length};
+}
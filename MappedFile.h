@@ -0,0 +1,36 @@
+#pragma once
+
+#include <cstddef>
+#include <string_view>
+
+
+//входной файл, отображенный в память только для чтения
+class MappedFile {
+public:
+    MappedFile();
+
+    explicit MappedFile(const char *path);
+
+    ~MappedFile();
+
+    bool open(const char *path);
+
+    void close();
+
+    bool good() const;
+
+    const char *data() const;
+
+    size_t size() const;
+
+    std::string_view view(size_t offset, size_t length) const;   //подстрока без копирования
+
+    MappedFile(MappedFile const&) = delete;
+    MappedFile& operator=(MappedFile const&) = delete;
+
+private:
+    const char *data_;
+    size_t size_;
+    bool mapped_;
+    bool good_;
+};
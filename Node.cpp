@@ -1,17 +1,19 @@
 #include "Node.h"
+#include "Value.h"
 #include "Error.h"
+#include "Lexer.h"
 
 
 Token* Parser::next() {
-    return &program[++i];
+    return lexer->at(++i);
 }
 
 Token* Parser::cur() {
-    return &program[i];
+    return lexer->at(i);
 }
 
 Token* Parser::get() {
-    return &program[i++];
+    return lexer->at(i++);
 }
 
 bool Parser::skip(Tag x) {
@@ -23,74 +25,58 @@ bool Parser::skip(Tag x) {
     return true;
 }
 
-void Parser::init(std::vector<Token> &ts) {
-    program = ts;
+void Parser::init(Lexer &l, const Tokens &ts, replacement_map &r, Ast &a) {
+    lexer = &l;
+    tokens = &ts;
     i = 0;
+    reps = &r;
+    ast = &a;
 }
 
+Coordinate Parser::coord(const Token *t) {
+    return tokens->coord(t->start);
+}
 
-Node::Node() = default;
-
-Node::Node(const Node &n) : _coord(n._coord), _tag(n._tag), _label(n._label), _priority(n._priority) {
-    if (n.left) left = new Node(*n.left);
-    if (n.right) right = new Node(*n.right);
-    if (n.cond) cond = new Node(*n.cond);
-    for (auto field : n.fields) {
-        fields.push_back(new Node(*field));
+node_id Parser::node(Token *t) {
+    Tag tag = t->_tag;
+    if (tag == NUMBER || tag == IDENT || tag == KEYWORD || tag == DIMENSION) {
+        return ast->add(tag, std::string(tokens->text(*t)), coord(t));
     }
+    return ast->add(tag, t_info[tag].name, coord(t));
 }
 
-Node::~Node() {
-    delete left;
-    delete right;
-    delete cond;
-    for (auto & field : fields) {
-        delete field;
-    }
+node_id Parser::node(Tag t, const Coordinate& c) {
+    return ast->add(t, t_info[t].name, c);
 }
 
+
 void Node::print(const std::string& pref) const {
-    std::string img = t_info[_tag].name + ((_label.empty()) ? "" : "(" + _label + ")");
-    printf("%s Node: %s, %d\n", pref.c_str(), img.c_str(), _priority);
+    Tag tag = get_tag();
+    const std::string& label = get_label();
+    std::string img = t_info[tag].name + ((label.empty()) ? "" : "(" + label + ")");
+    printf("%s Node: %s, %d\n", pref.c_str(), img.c_str(), t_info[tag].priority);
 
-    if (left) {
-        left->print(pref + "l");
+    if (left()) {
+        left().print(pref + "l");
     }
-    if (right) {
-        right->print(pref + "r");
+    if (right()) {
+        right().print(pref + "r");
     }
-    if (cond) {
-        cond->print(pref + "c");
+    if (cond()) {
+        cond().print(pref + "c");
     }
 
-    size_t n = fields.size();
+    NodeList f = fields();
+    size_t n = f.size();
     for (size_t i = 0; i < n; i++) {
-        fields[i]->print(pref + "[" + std::to_string(i) + "]");
+        f[i].print(pref + "[" + std::to_string(i) + "]");
     }
 }
 
-void Node::set_tag(Tag t) {
-    _tag = t;
-    _label = t_info[_tag].name;
-    _priority = t_info[_tag].priority;
-}
-
-Tag& Node::get_tag() {
-    return _tag;
-}
-
-std::string& Node::get_label() {
-    return _label;
-}
-
-std::string& Node::toString() {
-    return _label;
-}
-
-Node *Parser::expression(int pr) {  //выражение
+node_id Parser::expression(int pr) {  //выражение
     Token *ptr = get();
 
-    Node *lhs = Parser::unexpr(ptr);
+    node_id lhs = Parser::unexpr(ptr);
 
     while (pr < t_info[cur()->_tag].priority) {
         ptr = get();
@@ -99,8 +85,8 @@ Node *Parser::expression(int pr) {  //выражение
     return lhs;
 }
 
-std::vector<Node *> Parser::block(Tag stop) {   //блок
-    std::vector<Node *> block;
+std::vector<node_id> Parser::block(Tag stop) {   //блок
+    std::vector<node_id> block;
 
     while (cur()->_tag != stop) {
         if (cur()->_tag == BREAK) {
@@ -112,12 +98,27 @@ std::vector<Node *> Parser::block(Tag stop) {   //блок
     return block;
 }
 
-std::vector<Node *> Parser::line() {
-    std::vector<Node *> res;
+std::vector<node_id> Parser::statements(std::vector<replacement_map> &r) {
+    std::vector<node_id> block;
+
+    while (cur()->_tag != NONE) {
+        if (cur()->_tag == BREAK) {
+            get();
+            continue;
+        }
+        r.emplace_back();
+        reps = &r.back();
+        block.push_back(expression(0));
+    }
+    return block;
+}
+
+std::vector<node_id> Parser::line() {
+    std::vector<node_id> res;
     Tag ctag = cur()->_tag;
 
     if (ctag == AMP || ctag == BREAK || ctag == ENDM) {
-        throw Error(cur()->start.start, "Bad matrix");
+        throw Error(coord(cur()), "Bad matrix");
     }
     res.push_back(expression(0));
     while (cur()->_tag == AMP) {
@@ -127,49 +128,38 @@ std::vector<Node *> Parser::line() {
     return res;
 }
 
-std::vector<Node *> Parser::matrix() {
-    std::vector<Node *> res;
-    Node *row = new Node();
-    row->set_tag(LIST);
-    row->_coord = cur()->start.start;
-    row->fields = line();
+std::vector<node_id> Parser::matrix() {
+    std::vector<node_id> res;
+    node_id row = node(LIST, coord(cur()));
+    std::vector<node_id> fields = line();
+    ast->set_fields(row, fields);
     res.push_back(row);
-    size_t N = row->fields.size();
+    size_t N = fields.size();
     while (cur()->_tag == BREAK) {
         get();
-        row = new Node();
-        row->set_tag(LIST);
-        row->_coord = cur()->start.start;
-        row->fields = line();
+        row = node(LIST, coord(cur()));
+        fields = line();
+        ast->set_fields(row, fields);
         res.push_back(row);
-        if (N != row->fields.size()) {
-            for (auto it = row->fields.begin(); it != row->fields.end(); ++it) {
-                delete *it;
-                throw Error(row->_coord, "Matrix is not rectangular");
-            }
+        if (N != fields.size()) {
+            throw Error(ast->coord(row), "Matrix is not rectangular");
         }
     }
     return res;
 }
 
-std::vector<Node *> Parser::cases() {
-    std::vector<Node *> res;
+std::vector<node_id> Parser::cases() {
+    std::vector<node_id> res;
     do {
-        Node *alt = new Node();
-        alt->set_tag(ALT);
-        alt->_coord = cur()->start.start;
-        alt->right = expression(0);
+        node_id alt = node(ALT, coord(cur()));
+        ast->set_right(alt, expression(0));
 
         Tag t = get()->_tag;    // тег должен быть WHEN или OTHERWISE
         if (t == WHEN) {
-            alt->cond = expression(0);
+            ast->set_cond(alt, expression(0));
         }
         else if (t != OTHERWISE) {
-            delete alt;
-            for (auto & re : res) {
-                delete re;
-            }
-            throw Error(cur()->start.start, "Unexpected symbol - expected \\when or \\otherwise");
+            throw Error(coord(cur()), "Unexpected symbol - expected \\when or \\otherwise");
         }
         res.push_back(alt);
 
@@ -182,8 +172,8 @@ std::vector<Node *> Parser::cases() {
     return res;
 }
 
-std::vector<Node *> Parser::list(Tag close) {  //список аргументов
-    std::vector<Node *> res;
+std::vector<node_id> Parser::list(Tag close) {  //список аргументов
+    std::vector<node_id> res;
     Tag next = Parser::next()->_tag;   //скипнуть (, перейти на следующий токен
     if (next == close) {            //пустой список, скипнуть )
         get();
@@ -194,105 +184,105 @@ std::vector<Node *> Parser::list(Tag close) {  //список аргументо
             next = get()->_tag;             //если запятая, то продолжить цикл
         } while (next == COMMA);
         if (next != close) {               //если выход не на ), то это ошибка
-            for (auto & re : res) {
-                delete re;
-            }
-            throw Error(cur()->start.start, "List not closed");
+            throw Error(coord(cur()), "List not closed");
         }
     }
     return res;
 }
 
-Node *Parser::binexpr(Token *rhs, Node *lhs) {
+node_id Parser::binexpr(Token *rhs, node_id lhs) {
     rhs->binary();
-    Node *res = new Node(rhs);
+    node_id res = node(rhs);
+    Tag tag = ast->tag(res);
 
-    Tag close_tag = t_info[res->_tag].close_tag;
+    Tag close_tag = t_info[tag].close_tag;
 
-    res->left = lhs;
-    int pr = res->_priority;
-    if (t_info[res->_tag].is_inverted) --pr;
-    res->right = expression(pr);
+    ast->set_left(res, lhs);
+    int pr = t_info[tag].priority;
+    if (t_info[tag].is_inverted) --pr;
+    ast->set_right(res, expression(pr));
 
     if (close_tag) {    //это вообще когда-нибудь срабатывает?
         if (!skip(close_tag)) {
-            delete res;
-            throw Error(cur()->start.start, "Unexpected symbol");
+            throw Error(coord(cur()), "Unexpected symbol");
         }
     }
 
     return res;
 }
 
-Node *Parser::unexpr(Token *t) {
+node_id Parser::unexpr(Token *t) {
     t->unary();
-    Node *res = new Node(t);
-    Tag close_tag = t_info[res->_tag].close_tag;
+    node_id res = node(t);
+    Tag tag = ast->tag(res);
+    if (tag == PLACEHOLDER) {
+        save_rep(ast->coord(res), PLACEHOLDER, t->end - 2, t->end);
+    }
+    Tag close_tag = t_info[tag].close_tag;
 
     // если это выражение в скобках
     if (close_tag) {
-        if (res->_tag == BEGINB) {
-            res->fields = block(close_tag);
+        if (tag == BEGINB) {
+            ast->set_fields(res, block(close_tag));
         }
-        else if (res->_tag == BEGINC) {
-            res->fields = cases();
+        else if (tag == BEGINC) {
+            ast->set_fields(res, cases());
         }
-        else if (res->_tag == BEGINM) {
-            res->fields = matrix();
+        else if (tag == BEGINM) {
+            ast->set_fields(res, matrix());
         }
         else {    //выражение в простых скобках
-            delete res;
             res = expression(0);
         }
         if (!skip(close_tag)) {
-            delete res;
-            throw Error(cur()->start.start, "Unexpected symbol - expected close_tag");
+            throw Error(coord(cur()), "Unexpected symbol - expected close_tag");
         }
     }
-    else if (res->_tag == IDENT) {
+    else if (tag == IDENT) {
         if (cur()->_tag == INDEX) {  //обращение по индексу
             get();
             if (cur()->_tag == LBRACE) { //составной индекс: x_{1+2+3}, y_{q,w}
-                res->fields = list(RBRACE);
-                if (res->fields.size() < 1 || res->fields.size() > 2) {
-                    throw Error(res->_coord, "Bad index");
+                std::vector<node_id> index = list(RBRACE);
+                ast->set_fields(res, index);
+                if (index.size() < 1 || index.size() > 2) {
+                    throw Error(ast->coord(res), "Bad index");
                 }
             }
             else {  //простой индекс: x_1, y_z
-                res->fields.push_back(unexpr(get()));
+                ast->set_fields(res, {unexpr(get())});
             }
         }
         if (cur()->_tag == LPAREN) { //если есть список аргументов, то это функция
-            res->_tag = FUNC;
-            res->fields = list(RPAREN);
+            ast->set_tag(res, FUNC);
+            ast->set_fields(res, list(RPAREN));
         }
     }
-    else if (res->_tag == KEYWORD) {
+    else if (tag == KEYWORD) {
         if (cur()->_tag == LPAREN) {
-            res->fields = list(RPAREN); //тег ключевого слова не надо менять на тег функции
+            ast->set_fields(res, list(RPAREN)); //тег ключевого слова не надо менять на тег функции
         }
     }
         //\newcommand{\range}[3][]
-    else if (res->_tag == RANGE) {
+    else if (tag == RANGE) {
         if (cur()->_tag == LBRACKET) {	//опциональный параметр - шаг
-            res->cond = expression(0);
+            ast->set_cond(res, expression(0));
         }
-        res->left = arg(LBRACE);
-        res->right = arg(LBRACE);
+        ast->set_left(res, arg(LBRACE));
+        ast->set_right(res, arg(LBRACE));
     }
-    else if (res->_tag == TRANSP) {
-        res->left = arg(LBRACE);
+    else if (tag == TRANSP) {
+        ast->set_left(res, arg(LBRACE));
     }
-    else if (res->_tag == FRAC) {
-        res->left = arg(LBRACE);
-        res->right = arg(LBRACE);
+    else if (tag == FRAC) {
+        ast->set_left(res, arg(LBRACE));
+        ast->set_right(res, arg(LBRACE));
     }
-    else if (res->_tag == IF) {    //If ::= \ifexpr{ Expr } Operator (\otherwise Operator)?
-        res->cond = arg(LBRACE);
+    else if (tag == IF) {    //If ::= \ifexpr{ Expr } Operator (\otherwise Operator)?
+        ast->set_cond(res, arg(LBRACE));
         if (cur()->_tag == BREAK) {
             get();
         }
-        res->right = expression(0);
+        ast->set_right(res, expression(0));
         if (cur()->_tag == BREAK) {
             get();
         }
@@ -301,45 +291,61 @@ Node *Parser::unexpr(Token *t) {
             if (cur()->_tag == BREAK) {
                 get();
             }
-            res->left = expression(0);
+            ast->set_left(res, expression(0));
         }
     }
-    else if (res->_tag == WHILE || res->_tag == PRODUCT) {
-        res->cond = expression(0);
+    else if (tag == WHILE) {
+        ast->set_cond(res, expression(0));
         if (cur()->_tag == BREAK) {
             get();
         }
-        res->right = expression(0);
+        ast->set_right(res, expression(0));
+    }
+        //\sum_{i=a}^{b} Expr, \prod_{i=a}^{b} Expr: в left - равенство i = a, в cond - b, в right - тело.
+        //Тело заканчивается перед = и :=, чтобы \sum_{i=a}^{b} Expr = \placeholder{} выводило всю сумму
+    else if (tag == SUM || tag == PRODUCT) {
+        if (!skip(INDEX)) {
+            throw Error(coord(cur()), "Expected _{...}");
+        }
+        node_id from = arg(LBRACE);
+        if (ast->tag(from) != EQ || ast->tag(ast->left(from)) != IDENT ||
+            ast->field_count(ast->left(from)) != 0) {
+            throw Error(ast->coord(from), "Expected iteration variable");
+        }
+        if (!skip(POW)) {
+            throw Error(coord(cur()), "Expected ^{...}");
+        }
+        ast->set_left(res, from);
+        ast->set_cond(res, arg(LBRACE));
+        ast->set_right(res, expression(t_info[EQ].priority));
     }
         //\newcommand{\graphic}[3]
-    else if (res->_tag == GRAPHIC) {
-        delete res;
-        Node *tmp = arg(LBRACE);	//имя функции
-        if (tmp->_tag != IDENT) {
-            throw Error(tmp->_coord, "Expected identifier");
+    else if (tag == GRAPHIC) {
+        node_id tmp = arg(LBRACE);	//имя функции
+        if (ast->tag(tmp) != IDENT) {
+            throw Error(ast->coord(tmp), "Expected identifier");
         }
         res = tmp;
-        res->_tag = GRAPHIC;
+        ast->set_tag(res, GRAPHIC);
         if (cur()->_tag != LBRACE) {
-            delete res;
-            throw Error(cur()->start.start, "Expected argument");
+            throw Error(coord(cur()), "Expected argument");
         }
-        res->fields = list(RBRACE);	//поля
-        size_t a = cur()->start.index;
+        ast->set_fields(res, list(RBRACE));	//поля
+        size_t a = cur()->start;
         Parser::wait(RBRACE);				//точки графика парсить не нужно
-        size_t b = cur()->start.index;
-        Node::save_rep(res->_coord, GRAPHIC, a, b);
+        size_t b = cur()->start;
+        save_rep(ast->coord(res), GRAPHIC, a, b);
     }
-    else if (t_info[res->_tag].is_operator) {
-        res->right = expression(res->_priority);
+    else if (t_info[tag].is_operator) {
+        ast->set_right(res, expression(t_info[tag].priority));
     }
     return res;
 }
 
 //читает аргумент в скобках
-Node* Parser::arg(Tag open) {
+node_id Parser::arg(Tag open) {
     if (cur()->_tag != open) {
-        throw Error(cur()->start.start, "Expected argument");
+        throw Error(coord(cur()), "Expected argument");
     }
     return expression(666);
 }
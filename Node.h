@@ -1,15 +1,28 @@
 #pragma once
 
 #include "Coordinate.h"
+#include "Ast.h"
 
 
 class Value;
 
 class Node;
 
+class Context;
+
+class Lexer;
+
+struct Replacement;
+
+
+typedef std::map<Coordinate, Replacement> replacement_map;
+
 typedef struct Parser {
-	std::vector<Token> program;
+	Lexer *lexer = nullptr;             //токены читаются из лексера по одному, парсер меняет только теги операций
+	const Tokens *tokens = nullptr;     //тексты и координаты токенов
 	int i = 0;
+	replacement_map *reps = nullptr;    //сюда парсер записывает места замен блока
+	Ast *ast = nullptr;                 //узлы добавляются в дерево блока
 
 	Token *next();
 
@@ -19,25 +32,35 @@ typedef struct Parser {
 
 	bool skip(Tag);
 
-	void init(std::vector<Token> &);
+	void init(Lexer &, const Tokens &, replacement_map &, Ast &);
+
+	Coordinate coord(const Token *);
 
-	Node *unexpr(Token *);
+	node_id node(Token *);
 
-	Node *binexpr(Token *, Node *);
+	node_id node(Tag, const Coordinate&);
 
-	Node *expression(int = 0);
+	void save_rep(const Coordinate&, Tag, size_t, size_t);
 
-	std::vector<Node *> block(Tag = NONE);
+	node_id unexpr(Token *);
 
-	std::vector<Node *> line();
+	node_id binexpr(Token *, node_id);
 
-	std::vector<Node *> cases();
+	node_id expression(int = 0);
 
-	std::vector<Node *> list(Tag close);
+	std::vector<node_id> block(Tag = NONE);
 
-	std::vector<Node *> matrix();
+	std::vector<node_id> statements(std::vector<replacement_map> &);   //блок верхнего уровня, места замен по операторам
 
-	Node * arg(Tag open);
+	std::vector<node_id> line();
+
+	std::vector<node_id> cases();
+
+	std::vector<node_id> list(Tag close);
+
+	std::vector<node_id> matrix();
+
+	node_id arg(Tag open);
 
 	void wait(Tag stop);
 } Parser;
@@ -45,55 +68,92 @@ typedef struct Parser {
 
 typedef std::map<std::string, Value> name_table;
 
+struct Frame;
 
-struct Replacement;
 
+class NodeList;
 
-typedef std::map<Coordinate, Replacement> replacement_map;
+//узел дерева Ast: номер и само дерево, копируется по значению.
+//Пустой узел (номер 0) означает отсутствие потомка
+class Node {
+public:
+	Node() = default;
 
+	Node(const Ast *ast, node_id id) : ast_(ast), id_(id) {}
 
-class Node {
-	friend struct Parser;
+	explicit operator bool() const { return id_ != 0; }
 
-	Coordinate _coord;
-	Tag _tag = ERROR;
-	std::string _label;
-	int _priority = 0;
-public:
-	static name_table global;
-	static replacement_map reps;
-	Node *left = nullptr;
-	Node *right = nullptr;
-	Node *cond = nullptr;
-	std::vector<Node *> fields;
+	node_id id() const { return id_; }
+
+	const Ast *ast() const { return ast_; }
+
+	Tag get_tag() const { return ast_->tag(id_); }
 
-	Node();
+	const std::string& get_label() const { return ast_->label(id_); }
 
-	Node(const Node &n);
+	const std::string& toString() const { return ast_->label(id_); }
 
-	Node(Token *t);
+	double number() const { return ast_->number(id_); }
 
-	static void save_rep(const Coordinate&, Tag, size_t, size_t);
+	const Coordinate& coord() const { return ast_->coord(id_); }
 
-	virtual ~Node();
+	Node left() const { return {ast_, ast_->left(id_)}; }
+
+	Node right() const { return {ast_, ast_->right(id_)}; }
+
+	Node cond() const { return {ast_, ast_->cond(id_)}; }
+
+	NodeList fields() const;
 
 	void print(const std::string& pref) const;
 
-	void set_tag(Tag t);
+	Value exec(Context &ctx, Frame *scope) const;
+
+	void semantic_analysis(Context &ctx) const;
+
+private:
+	const Ast *ast_ = nullptr;
+	node_id id_ = 0;
+};
+
+//поля узла: подряд идущие номера в дереве
+class NodeList {
+public:
+	class iterator {
+	public:
+		iterator(const Ast *ast, const node_id *p) : ast_(ast), p_(p) {}
+
+		Node operator*() const { return {ast_, *p_}; }
+
+		iterator &operator++() { ++p_; return *this; }
+
+		bool operator!=(const iterator &other) const { return p_ != other.p_; }
+
+		bool operator==(const iterator &other) const { return p_ == other.p_; }
+
+	private:
+		const Ast *ast_;
+		const node_id *p_;
+	};
 
-    Tag& get_tag();
+	NodeList(const Ast *ast, const node_id *begin, size_t size) : ast_(ast), begin_(begin), size_(size) {}
 
-    std::string& get_label();
+	size_t size() const { return size_; }
 
-    std::string& toString();
+	bool empty() const { return size_ == 0; }
 
-	Value exec(name_table *nt);
+	Node operator[](size_t i) const { return {ast_, begin_[i]}; }
 
-	static void copy_defs(name_table &local, name_table *ptr);
+	iterator begin() const { return {ast_, begin_}; }
 
-	static Value &lookup(const std::string& name, name_table *ptr, const Coordinate&);
+	iterator end() const { return {ast_, begin_ + size_}; }
 
-	static void def(const std::string& name, const Value&, name_table *ptr);
+private:
+	const Ast *ast_;
+	const node_id *begin_;
+	size_t size_;
+};
 
-    void semantic_analysis();
-};
\ No newline at end of file
+inline NodeList Node::fields() const {
+	return {ast_, ast_->fields(id_), ast_->field_count(id_)};
+}
@@ -0,0 +1,72 @@
+#include <algorithm>
+#include <climits>
+#include <cerrno>
+#include <sys/uio.h>
+
+#include "OutputBuffer.h"
+
+
+void OutputBuffer::span(std::string_view s) {
+    if (s.empty()) return;
+    size_ += s.size();
+    if (!segments_.empty()) {
+        std::string_view &last = segments_.back();
+        if (last.data() + last.size() == s.data()) {   //соседние куски входного файла склеиваются
+            last = std::string_view(last.data(), last.size() + s.size());
+            return;
+        }
+    }
+    segments_.push_back(s);
+}
+
+void OutputBuffer::fragment(std::string s) {
+    if (s.empty()) return;
+    fragments_.push_back(std::move(s));
+    size_ += fragments_.back().size();
+    segments_.emplace_back(fragments_.back());
+}
+
+size_t OutputBuffer::segments() const {
+    return segments_.size();
+}
+
+size_t OutputBuffer::size() const {
+    return size_;
+}
+
+bool OutputBuffer::write_to(int fd) {
+    std::vector<iovec> iov(segments_.size());
+    for (size_t i = 0; i < segments_.size(); ++i) {
+        iov[i].iov_base = const_cast<char *>(segments_[i].data());
+        iov[i].iov_len = segments_[i].size();
+    }
+
+    size_t first = 0;
+    while (first < iov.size()) {
+        int count = static_cast<int>(std::min<size_t>(iov.size() - first, IOV_MAX));
+        ssize_t written = writev(fd, &iov[first], count);
+        if (written < 0) {
+            if (errno == EINTR) continue;
+            clear();
+            return false;
+        }
+        //частичная запись: пропустить записанные сегменты и сдвинуть начало недописанного
+        size_t w = written;
+        while (first < iov.size() && w >= iov[first].iov_len) {
+            w -= iov[first].iov_len;
+            ++first;
+        }
+        if (w) {
+            iov[first].iov_base = static_cast<char *>(iov[first].iov_base) + w;
+            iov[first].iov_len -= w;
+        }
+    }
+    clear();
+    return true;
+}
+
+void OutputBuffer::clear() {
+    segments_.clear();
+    fragments_.clear();
+    size_ = 0;
+}
@@ -0,0 +1,29 @@
+#pragma once
+
+#include <string>
+#include <string_view>
+#include <vector>
+#include <deque>
+
+
+//выходной файл собирается из сегментов: куски входного файла (не копируются)
+//и сгенерированные фрагменты; все сегменты пишутся одним вызовом writev
+class OutputBuffer {
+public:
+    void span(std::string_view s);      //s должна жить до записи: view во входной файл или литерал
+
+    void fragment(std::string s);       //сгенерированный текст, буфер хранит его сам
+
+    size_t segments() const;
+
+    size_t size() const;
+
+    bool write_to(int fd);              //записать и очистить буфер
+
+    void clear();
+
+private:
+    std::vector<std::string_view> segments_;
+    std::deque<std::string> fragments_; //deque не перемещает элементы, view на них остаются валидными
+    size_t size_ = 0;
+};
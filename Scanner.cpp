@@ -0,0 +1,261 @@
+#include <algorithm>
+
+#include "Scanner.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define SCANNER_X86
+#endif
+
+
+//кандидаты: '%' и '\', за которым идет "be" или "en"; за 64 байтами блока читается еще 2
+static bool delim_at(const char *p) {
+    return *p == '%' || (*p == '\\' && ((p[1] == 'b' && p[2] == 'e') || (p[1] == 'e' && p[2] == 'n')));
+}
+
+static uint64_t delims_scalar(const char *p) {
+    uint64_t m = 0;
+    for (int i = 0; i < 64; ++i) {
+        if (delim_at(p + i)) m |= uint64_t(1) << i;
+    }
+    return m;
+}
+
+static uint64_t newlines_scalar(const char *p) {
+    uint64_t m = 0;
+    for (int i = 0; i < 64; ++i) {
+        if (p[i] == '\n') m |= uint64_t(1) << i;
+    }
+    return m;
+}
+
+//классы символов лексера по битам Scanner::run, как isspace, isalpha, isdigit и isalnum в локали "C"
+static constexpr struct Classes {
+    uint8_t bits[256];
+
+    constexpr Classes() : bits() {
+        for (int c = 0; c < 256; ++c) {
+            bool space = c == ' ' || (c >= '\t' && c <= '\r');
+            bool letter = (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z');
+            bool digit = c >= '0' && c <= '9';
+            bits[c] = (space << Scanner::SPACES) | (letter << Scanner::LETTERS) |
+                      (digit << Scanner::DIGITS) | ((letter || digit) << Scanner::ALNUMS);
+        }
+    }
+} classes;
+
+template<Scanner::run k>
+static uint64_t run_scalar(const char *p) {
+    uint64_t m = 0;
+    for (int i = 0; i < 64; ++i) {
+        if (classes.bits[uint8_t(p[i])] & (1 << k)) m |= uint64_t(1) << i;
+    }
+    return m;
+}
+
+#ifdef SCANNER_X86
+__attribute__((target("sse2")))
+static uint64_t delims_sse2(const char *p) {
+    const __m128i slash = _mm_set1_epi8('\\');
+    const __m128i percent = _mm_set1_epi8('%');
+    const __m128i b = _mm_set1_epi8('b');
+    const __m128i e = _mm_set1_epi8('e');
+    const __m128i n = _mm_set1_epi8('n');
+    uint64_t m = 0;
+    for (int i = 0; i < 4; ++i) {
+        __m128i x = _mm_loadu_si128(reinterpret_cast<const __m128i *>(p + 16 * i));
+        __m128i y = _mm_loadu_si128(reinterpret_cast<const __m128i *>(p + 16 * i + 1));
+        __m128i z = _mm_loadu_si128(reinterpret_cast<const __m128i *>(p + 16 * i + 2));
+        __m128i be = _mm_and_si128(_mm_cmpeq_epi8(y, b), _mm_cmpeq_epi8(z, e));
+        __m128i en = _mm_and_si128(_mm_cmpeq_epi8(y, e), _mm_cmpeq_epi8(z, n));
+        __m128i cmd = _mm_and_si128(_mm_cmpeq_epi8(x, slash), _mm_or_si128(be, en));
+        __m128i eq = _mm_or_si128(cmd, _mm_cmpeq_epi8(x, percent));
+        m |= uint64_t(uint16_t(_mm_movemask_epi8(eq))) << (16 * i);
+    }
+    return m;
+}
+
+__attribute__((target("sse2")))
+static uint64_t newlines_sse2(const char *p) {
+    const __m128i nl = _mm_set1_epi8('\n');
+    uint64_t m = 0;
+    for (int i = 0; i < 4; ++i) {
+        __m128i x = _mm_loadu_si128(reinterpret_cast<const __m128i *>(p + 16 * i));
+        m |= uint64_t(uint16_t(_mm_movemask_epi8(_mm_cmpeq_epi8(x, nl)))) << (16 * i);
+    }
+    return m;
+}
+
+//байты со знаком: все, что выше 0x7f, отрицательно и ни в один интервал не попадает
+__attribute__((target("sse2")))
+static __m128i class_sse2(__m128i x, Scanner::run k) {
+    __m128i space = _mm_or_si128(_mm_cmpeq_epi8(x, _mm_set1_epi8(' ')),
+                                 _mm_and_si128(_mm_cmpgt_epi8(x, _mm_set1_epi8('\t' - 1)), _mm_cmplt_epi8(x, _mm_set1_epi8('\r' + 1))));
+    if (k == Scanner::SPACES) return space;
+    __m128i lower = _mm_or_si128(x, _mm_set1_epi8(0x20));
+    __m128i letter = _mm_and_si128(_mm_cmpgt_epi8(lower, _mm_set1_epi8('a' - 1)), _mm_cmplt_epi8(lower, _mm_set1_epi8('z' + 1)));
+    __m128i digit = _mm_and_si128(_mm_cmpgt_epi8(x, _mm_set1_epi8('0' - 1)), _mm_cmplt_epi8(x, _mm_set1_epi8('9' + 1)));
+    if (k == Scanner::LETTERS) return letter;
+    if (k == Scanner::DIGITS) return digit;
+    return _mm_or_si128(letter, digit);
+}
+
+template<Scanner::run k>
+__attribute__((target("sse2")))
+static uint64_t run_sse2(const char *p) {
+    uint64_t m = 0;
+    for (int i = 0; i < 4; ++i) {
+        __m128i x = _mm_loadu_si128(reinterpret_cast<const __m128i *>(p + 16 * i));
+        m |= uint64_t(uint16_t(_mm_movemask_epi8(class_sse2(x, k)))) << (16 * i);
+    }
+    return m;
+}
+
+__attribute__((target("avx2")))
+static uint32_t delims_avx2_32(const char *p) {
+    __m256i x = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(p));
+    __m256i y = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(p + 1));
+    __m256i z = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(p + 2));
+    __m256i be = _mm256_and_si256(_mm256_cmpeq_epi8(y, _mm256_set1_epi8('b')), _mm256_cmpeq_epi8(z, _mm256_set1_epi8('e')));
+    __m256i en = _mm256_and_si256(_mm256_cmpeq_epi8(y, _mm256_set1_epi8('e')), _mm256_cmpeq_epi8(z, _mm256_set1_epi8('n')));
+    __m256i cmd = _mm256_and_si256(_mm256_cmpeq_epi8(x, _mm256_set1_epi8('\\')), _mm256_or_si256(be, en));
+    __m256i eq = _mm256_or_si256(cmd, _mm256_cmpeq_epi8(x, _mm256_set1_epi8('%')));
+    return uint32_t(_mm256_movemask_epi8(eq));
+}
+
+__attribute__((target("avx2")))
+static uint64_t delims_avx2(const char *p) {
+    return uint64_t(delims_avx2_32(p)) | (uint64_t(delims_avx2_32(p + 32)) << 32);
+}
+
+__attribute__((target("avx2")))
+static uint64_t newlines_avx2(const char *p) {
+    const __m256i nl = _mm256_set1_epi8('\n');
+    __m256i lo = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(p));
+    __m256i hi = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(p + 32));
+    return uint64_t(uint32_t(_mm256_movemask_epi8(_mm256_cmpeq_epi8(lo, nl)))) |
+           (uint64_t(uint32_t(_mm256_movemask_epi8(_mm256_cmpeq_epi8(hi, nl)))) << 32);
+}
+
+__attribute__((target("avx2")))
+static __m256i class_avx2(__m256i x, Scanner::run k) {
+    __m256i space = _mm256_or_si256(_mm256_cmpeq_epi8(x, _mm256_set1_epi8(' ')),
+                                    _mm256_and_si256(_mm256_cmpgt_epi8(x, _mm256_set1_epi8('\t' - 1)), _mm256_cmpgt_epi8(_mm256_set1_epi8('\r' + 1), x)));
+    if (k == Scanner::SPACES) return space;
+    __m256i lower = _mm256_or_si256(x, _mm256_set1_epi8(0x20));
+    __m256i letter = _mm256_and_si256(_mm256_cmpgt_epi8(lower, _mm256_set1_epi8('a' - 1)), _mm256_cmpgt_epi8(_mm256_set1_epi8('z' + 1), lower));
+    __m256i digit = _mm256_and_si256(_mm256_cmpgt_epi8(x, _mm256_set1_epi8('0' - 1)), _mm256_cmpgt_epi8(_mm256_set1_epi8('9' + 1), x));
+    if (k == Scanner::LETTERS) return letter;
+    if (k == Scanner::DIGITS) return digit;
+    return _mm256_or_si256(letter, digit);
+}
+
+template<Scanner::run k>
+__attribute__((target("avx2")))
+static uint64_t run_avx2(const char *p) {
+    __m256i lo = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(p));
+    __m256i hi = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(p + 32));
+    return uint64_t(uint32_t(_mm256_movemask_epi8(class_avx2(lo, k)))) |
+           (uint64_t(uint32_t(_mm256_movemask_epi8(class_avx2(hi, k)))) << 32);
+}
+#endif
+
+typedef struct Isa {
+    const char *name;
+    Scanner::mask_fn delims;
+    Scanner::mask_fn newlines;
+    Scanner::mask_fn runs[4];   //по Scanner::run
+} Isa;
+
+static Isa select_isa() {
+#ifdef SCANNER_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2")) {
+        return {"avx2", delims_avx2, newlines_avx2,
+                {run_avx2<Scanner::SPACES>, run_avx2<Scanner::LETTERS>, run_avx2<Scanner::DIGITS>, run_avx2<Scanner::ALNUMS>}};
+    }
+    if (__builtin_cpu_supports("sse2")) {
+        return {"sse2", delims_sse2, newlines_sse2,
+                {run_sse2<Scanner::SPACES>, run_sse2<Scanner::LETTERS>, run_sse2<Scanner::DIGITS>, run_sse2<Scanner::ALNUMS>}};
+    }
+#endif
+    return {"scalar", delims_scalar, newlines_scalar,
+            {run_scalar<Scanner::SPACES>, run_scalar<Scanner::LETTERS>, run_scalar<Scanner::DIGITS>, run_scalar<Scanner::ALNUMS>}};
+}
+
+static const Isa isa_ = select_isa();
+
+Scanner::Scanner() : data_(nullptr), size_(0), base_(SIZE_MAX), mask_(0), delims_(isa_.delims), newlines_(isa_.newlines) {}
+
+void Scanner::reset(const char *data, size_t size) {
+    data_ = data;
+    size_ = size;
+    base_ = SIZE_MAX;
+    mask_ = 0;
+}
+
+size_t Scanner::skip(run k, const char *data, size_t from, size_t to) {
+    //имена и числа обычно короткие: первые байты проверяются по таблице, длинные серии - блоками по 64
+    for (size_t e = std::min(to, from + 16); from < e; ++from) {
+        if (!(classes.bits[uint8_t(data[from])] & (1 << k))) return from;
+    }
+    for (mask_fn f = isa_.runs[k]; from + 64 <= to; from += 64) {
+        uint64_t m = ~f(data + from);
+        if (m) return from + __builtin_ctzll(m);
+    }
+    for (; from < to; ++from) {
+        if (!(classes.bits[uint8_t(data[from])] & (1 << k))) return from;
+    }
+    return to;
+}
+
+const char *Scanner::isa() {
+    return isa_.name;
+}
+
+size_t Scanner::find(size_t from) {
+    while (from < size_) {
+        size_t base = from & ~size_t(63);
+        if (base + 66 > size_) {    //хвост читается побайтно, за конец отображения выходить нельзя
+            for (; from + 2 < size_; ++from) {
+                if (delim_at(data_ + from)) return from;
+            }
+            for (; from < size_; ++from) {
+                if (data_[from] == '%') return from;
+            }
+            return size_;
+        }
+        if (base != base_) {
+            base_ = base;
+            mask_ = delims_(data_ + base);
+        }
+        uint64_t m = mask_ & (~uint64_t(0) << (from - base));
+        if (m) {
+            return base + __builtin_ctzll(m);
+        }
+        from = base + 64;
+    }
+    return size_;
+}
+
+size_t Scanner::lines(size_t from, size_t to) const {
+    size_t n = 0;
+    for (; from + 64 <= to; from += 64) {
+        n += __builtin_popcountll(newlines_(data_ + from));
+    }
+    for (; from < to; ++from) {
+        n += (data_[from] == '\n');
+    }
+    return n;
+}
+
+void Scanner::line_starts(size_t from, size_t to, std::vector<uint32_t>& res) const {
+    for (; from + 64 <= to; from += 64) {
+        for (uint64_t m = newlines_(data_ + from); m; m &= m - 1) {
+            res.push_back(from + __builtin_ctzll(m) + 1);
+        }
+    }
+    for (; from < to; ++from) {
+        if (data_[from] == '\n') res.push_back(from + 1);
+    }
+}
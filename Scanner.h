@@ -0,0 +1,39 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+
+//поиск разделителей во входном файле: байты сравниваются блоками по 64 с помощью AVX2 или SSE2,
+//если процессор их поддерживает, иначе побайтно. Набор инструкций выбирается при запуске программы
+class Scanner {
+public:
+    enum run {
+        SPACES, LETTERS, DIGITS, ALNUMS
+    };
+
+    Scanner();
+
+    void reset(const char *data, size_t size);
+
+    size_t find(size_t from);   //следующий '%' или '\' перед "be"/"en" не раньше from; size, если таких нет
+
+    size_t lines(size_t from, size_t to) const;   //число '\n' в [from, to)
+
+    void line_starts(size_t from, size_t to, std::vector<uint32_t>& res) const;  //смещения байтов после '\n' в [from, to)
+
+    static size_t skip(run k, const char *data, size_t from, size_t to);  //первый байт в [from, to) не из класса k; to, если таких нет
+
+    static const char *isa();   //выбранный набор инструкций, для отладки
+
+    typedef uint64_t (*mask_fn)(const char *p);    //маска подходящих байтов p[0..63]
+
+private:
+    const char *data_;
+    size_t size_;
+    size_t base_;       //начало последнего просмотренного блока из 64 байт
+    uint64_t mask_;     //маска кандидатов этого блока
+    mask_fn delims_;
+    mask_fn newlines_;
+};
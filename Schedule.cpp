@@ -0,0 +1,248 @@
+#include <algorithm>
+
+#include "Schedule.h"
+
+
+static void merge(std::set<std::string>& to, const std::set<std::string>& from) {
+    to.insert(from.begin(), from.end());
+}
+
+//имена поддерева n. Тело функции выполняется не при определении, а при вызове,
+//поэтому оно собирается в funcs; plain - имена, которым присваивается произвольное значение
+static void collect(Node n, Deps& d, std::map<std::string, Deps>& funcs, std::set<std::string>& plain) {
+    if (!n) return;
+    Tag t = n.get_tag();
+    if (t == SET && n.left()) {
+        Node l = n.left();
+        if (l.get_tag() == FUNC) {
+            Deps body;
+            collect(n.right(), body, funcs, plain);
+            for (auto arg : l.fields()) {    //аргументы берутся из локальной таблицы функции
+                body.uses.erase(arg.get_label());
+            }
+            d.defs.insert(l.get_label());
+            merge(d.uses, body.uses);       //при определении функция копирует глобальные значения
+            Deps& f = funcs[l.get_label()];
+            merge(f.uses, body.uses);
+            merge(f.defs, body.defs);
+            merge(f.calls, body.calls);
+            return;
+        }
+        d.defs.insert(l.get_label());
+        if (l.fields().empty()) {
+            plain.insert(l.get_label());
+        } else {
+            d.uses.insert(l.get_label());  //элемент матрицы меняется на месте
+        }
+        for (auto f : l.fields()) collect(f, d, funcs, plain);
+        collect(n.right(), d, funcs, plain);
+        return;
+    }
+    if ((t == SUM || t == PRODUCT) && n.left()) {     //переменная цикла присваивается
+        Node var = n.left().left();
+        d.defs.insert(var.get_label());
+        plain.insert(var.get_label());
+        collect(n.left().right(), d, funcs, plain);
+        collect(n.cond(), d, funcs, plain);
+        collect(n.right(), d, funcs, plain);
+        return;
+    }
+    if (t == IDENT) {
+        d.uses.insert(n.get_label());
+    } else if (t == FUNC || t == GRAPHIC) {
+        d.uses.insert(n.get_label());
+        d.calls.insert(n.get_label());
+    }
+    collect(n.left(), d, funcs, plain);
+    collect(n.right(), d, funcs, plain);
+    collect(n.cond(), d, funcs, plain);
+    for (auto f : n.fields()) collect(f, d, funcs, plain);
+}
+
+Schedule::Schedule(Context& ctx, std::vector<Parsed>& parsed) : ctx_(ctx), parsed_(parsed), first_failed_(SIZE_MAX) {}
+
+void Schedule::build(size_t blocks) {
+    std::map<std::string, Deps> funcs;
+    std::set<std::string> plain;
+    for (size_t b = 0; b < blocks; ++b) {
+        NodeList stmts = parsed_[b].root.fields();
+        for (size_t k = 0; k < stmts.size(); ++k) {
+            Task t;
+            t.node = stmts[k];
+            t.reps = &parsed_[b].reps[k];
+            collect(t.node, t.deps, funcs, plain);
+            tasks_.push_back(std::move(t));
+        }
+    }
+
+    //вызов выполняет тела всех определений функции с этим именем; если функцией может оказаться
+    //другое значение (присваивание, аргумент), то тело любой функции документа
+    Deps any;
+    for (auto& f : funcs) {
+        merge(any.uses, f.second.uses);
+        merge(any.defs, f.second.defs);
+    }
+    for (auto& t : tasks_) {
+        std::vector<std::string> work(t.deps.calls.begin(), t.deps.calls.end());
+        std::set<std::string> seen;
+        while (!work.empty()) {
+            std::string name = work.back();
+            work.pop_back();
+            if (!seen.insert(name).second) continue;
+            auto f = funcs.find(name);
+            if (f == funcs.end() || plain.count(name)) {
+                merge(t.deps.uses, any.uses);
+                merge(t.deps.uses, any.defs);
+                merge(t.deps.defs, any.defs);
+                break;
+            }
+            //тело пишет в глобальную таблицу только уже существующие имена, поэтому они нужны и на входе
+            merge(t.deps.uses, f->second.uses);
+            merge(t.deps.uses, f->second.defs);
+            merge(t.deps.defs, f->second.defs);
+            work.insert(work.end(), f->second.calls.begin(), f->second.calls.end());
+        }
+    }
+
+    //ребра: чтение после записи, запись после записи и запись после чтения
+    std::map<std::string, size_t> last;
+    std::map<std::string, std::vector<size_t>> readers;
+    for (size_t j = 0; j < tasks_.size(); ++j) {
+        std::set<size_t> preds;
+        for (auto& name : tasks_[j].deps.uses) {
+            auto w = last.find(name);
+            if (w != last.end()) preds.insert(w->second);
+            readers[name].push_back(j);
+        }
+        for (auto& name : tasks_[j].deps.defs) {
+            auto w = last.find(name);
+            if (w != last.end()) preds.insert(w->second);
+            for (size_t r : readers[name]) {
+                if (r != j) preds.insert(r);
+            }
+            readers[name].clear();
+            last[name] = j;
+            writers_[name].push_back(j);
+        }
+        for (size_t p : preds) {
+            tasks_[p].next.push_back(j);
+        }
+        tasks_[j].pending = preds.size();
+    }
+}
+
+const Value *Schedule::input(size_t i, const std::string& name) const {
+    //последний из предшественников, который действительно записал имя; все они уже выполнены
+    auto w = writers_.find(name);
+    if (w == writers_.end()) return nullptr;
+    auto it = std::lower_bound(w->second.begin(), w->second.end(), i);
+    while (it != w->second.begin()) {
+        --it;
+        auto v = tasks_[*it].outputs.find(name);
+        if (v != tasks_[*it].outputs.end()) return &v->second;
+    }
+    return nullptr;
+}
+
+void Schedule::execute(size_t i) {
+    Task& t = tasks_[i];
+    Context child;
+    child.vm = ctx_.vm;
+    for (auto& name : t.deps.uses) {
+        const Value *v = input(i, name);
+        if (v) child.global.emplace(name, *v);
+    }
+
+    Record rec;
+    rec.defs_only = true;
+    std::swap(child.reps, *t.reps);
+    child.record(&rec);
+    try {
+        child.eval(t.node);
+    }
+    catch (...) {
+        t.error = std::current_exception();
+        t.failed = true;
+    }
+    child.record(nullptr);
+    std::swap(child.reps, *t.reps);
+
+    for (auto& name : rec.defs) {
+        auto it = child.global.find(name);
+        if (it != child.global.end()) t.outputs.emplace(name, std::move(it->second));
+    }
+}
+
+void Schedule::submit(ThreadPool& pool, size_t i) {
+    pool.submit([this, &pool, i] {
+        Task& t = tasks_[i];
+        if (!t.failed && i < first_failed_) {
+            execute(i);
+        } else {
+            t.failed = true;
+        }
+        if (t.failed) {
+            size_t f = first_failed_;
+            while (i < f && !first_failed_.compare_exchange_weak(f, i)) {}
+        }
+        std::vector<size_t> ready;
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            for (size_t j : t.next) {
+                if (t.failed) tasks_[j].failed = true;
+                if (--tasks_[j].pending == 0) ready.push_back(j);
+            }
+            if (++done_ == tasks_.size()) {
+                finished_.notify_all();     //под мьютексом: после этого Schedule может быть уничтожен
+            }
+        }
+        for (size_t j : ready) {
+            submit(pool, j);
+        }
+    });
+}
+
+void Schedule::run(ThreadPool& pool) {
+    //анализ не зависит от выполнения, он идет по порядку до первой ошибки лексера, парсера или анализа
+    size_t blocks = parsed_.size();
+    std::exception_ptr front;
+    for (size_t b = 0; b < parsed_.size() && !front; ++b) {
+        if (parsed_[b].error) {
+            front = parsed_[b].error;
+        } else {
+            try {
+                parsed_[b].root.semantic_analysis(ctx_);
+            }
+            catch (...) {
+                front = std::current_exception();
+            }
+        }
+        if (front) blocks = b;
+    }
+
+    build(blocks);
+    if (!tasks_.empty()) {
+        std::vector<size_t> roots;
+        for (size_t i = 0; i < tasks_.size(); ++i) {
+            if (tasks_[i].pending == 0) roots.push_back(i);
+        }
+        for (size_t i : roots) {
+            submit(pool, i);
+        }
+        std::unique_lock<std::mutex> lock(mutex_);
+        finished_.wait(lock, [this] { return done_ == tasks_.size(); });
+    }
+
+    //ошибки в порядке документа: выполнение предыдущих блоков идет раньше анализа следующего
+    for (auto& t : tasks_) {
+        if (t.error) std::rethrow_exception(t.error);
+    }
+    if (front) {
+        std::rethrow_exception(front);
+    }
+    for (auto& t : tasks_) {
+        for (auto& it : t.outputs) {
+            ctx_.global[it.first] = std::move(it.second);
+        }
+    }
+}
@@ -0,0 +1,64 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <exception>
+#include <map>
+#include <mutex>
+#include <set>
+#include <string>
+#include <vector>
+
+#include "Context.h"
+#include "ThreadPool.h"
+
+
+//имена, которые оператор может прочитать из глобальной таблицы и может в нее записать.
+//Оценка сверху: учитываются все ветви и тела всех определений вызываемых функций
+typedef struct Deps {
+    std::set<std::string> uses;
+    std::set<std::string> defs;
+    std::set<std::string> calls;
+} Deps;
+
+//выполнение всех блоков документа по графу зависимостей операторов верхнего уровня:
+//независимые операторы выполняются параллельно, каждый в своем контексте со своими входными значениями,
+//а определения переносятся в глобальную таблицу в порядке документа
+class Schedule {
+public:
+    Schedule(Context& ctx, std::vector<Parsed>& parsed);
+
+    //анализ блоков по порядку и выполнение; ошибка - та же, что была бы первой при последовательной обработке.
+    //После возврата значения замен лежат в parsed[i].reps
+    void run(ThreadPool& pool);
+
+private:
+    typedef struct Task {
+        Node node;
+        replacement_map *reps;
+        Deps deps;
+        std::vector<size_t> next;   //операторы, ждущие этот
+        size_t pending = 0;         //сколько предшественников еще не выполнено
+        name_table outputs;         //значения определенных имен после выполнения
+        std::exception_ptr error;
+        bool failed = false;        //ошибка в этом операторе или в предшественнике
+    } Task;
+
+    Context& ctx_;
+    std::vector<Parsed>& parsed_;
+    std::vector<Task> tasks_;
+    std::map<std::string, std::vector<size_t>> writers_;    //операторы, которые могут записать имя, по порядку
+
+    std::mutex mutex_;
+    std::condition_variable finished_;
+    size_t done_ = 0;
+    std::atomic<size_t> first_failed_;     //операторы после первой ошибки не нужны
+
+    void build(size_t blocks);
+
+    void submit(ThreadPool& pool, size_t i);
+
+    void execute(size_t i);
+
+    const Value *input(size_t i, const std::string& name) const;
+};
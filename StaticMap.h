@@ -0,0 +1,69 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string_view>
+
+
+//неизменяемая таблица со строковыми ключами. Совершенный хеш (затравка, при которой у ключей нет коллизий)
+//подбирается при компиляции, поиск - одно вычисление хеша и одно сравнение строк
+template<typename T, size_t N>
+class StaticMap {
+public:
+    typedef struct Entry {
+        std::string_view key{};
+        T value{};
+    } Entry;
+
+    constexpr StaticMap(const Entry (&entries)[N]) : entries_(), slots_(), seed_(0) {
+        for (size_t i = 0; i < N; ++i) {
+            entries_[i] = entries[i];
+        }
+        while (!place()) {
+            ++seed_;
+        }
+    }
+
+    constexpr const T *find(std::string_view key) const {   //nullptr, если ключа нет
+        uint8_t e = slots_[hash(key, seed_) & (SLOTS - 1)];
+        return (e && entries_[e - 1].key == key) ? &entries_[e - 1].value : nullptr;
+    }
+
+    constexpr size_t size() const { return N; }
+
+private:
+    static_assert(N > 0 && N < 255, "slot stores entry number + 1 in a byte");
+
+    static constexpr size_t slots_for(size_t n) {
+        size_t s = 1;
+        while (s < 4 * n) s <<= 1;  //при заполнении в четверть подходящая затравка находится за десятки попыток
+        return s;
+    }
+
+    static constexpr size_t SLOTS = slots_for(N);
+
+    static constexpr uint32_t hash(std::string_view s, uint32_t seed) {
+        uint32_t h = 2166136261u ^ seed;
+        for (char c : s) {
+            h ^= uint8_t(c);
+            h *= 16777619u;
+        }
+        return h ^ (h >> 15);
+    }
+
+    constexpr bool place() {
+        for (size_t i = 0; i < SLOTS; ++i) {
+            slots_[i] = 0;
+        }
+        for (size_t i = 0; i < N; ++i) {
+            uint8_t &s = slots_[hash(entries_[i].key, seed_) & (SLOTS - 1)];
+            if (s) return false;
+            s = uint8_t(i + 1);
+        }
+        return true;
+    }
+
+    Entry entries_[N];
+    uint8_t slots_[SLOTS];      //номер записи + 1, 0 - пусто
+    uint32_t seed_;
+};
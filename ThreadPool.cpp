@@ -0,0 +1,56 @@
+#include "ThreadPool.h"
+
+
+ThreadPool::ThreadPool(size_t n) {
+    if (n == 0) n = std::thread::hardware_concurrency();
+    if (n == 0) n = 1;
+    for (size_t i = 0; i < n; ++i) {
+        workers_.emplace_back(&ThreadPool::work, this);
+    }
+}
+
+ThreadPool::~ThreadPool() {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stop_ = true;
+    }
+    has_task_.notify_all();
+    for (auto &w : workers_) w.join();
+}
+
+void ThreadPool::submit(std::function<void()> task) {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        tasks_.push(std::move(task));
+    }
+    has_task_.notify_one();
+}
+
+void ThreadPool::wait() {
+    std::unique_lock<std::mutex> lock(mutex_);
+    done_.wait(lock, [this] { return tasks_.empty() && active_ == 0; });
+}
+
+size_t ThreadPool::size() const {
+    return workers_.size();
+}
+
+void ThreadPool::work() {
+    for (;;) {
+        std::function<void()> task;
+        {
+            std::unique_lock<std::mutex> lock(mutex_);
+            has_task_.wait(lock, [this] { return stop_ || !tasks_.empty(); });
+            if (tasks_.empty()) return;     //stop_ и очередь пуста
+            task = std::move(tasks_.front());
+            tasks_.pop();
+            ++active_;
+        }
+        task();     //задачи сами ловят свои исключения
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            --active_;
+            if (tasks_.empty() && active_ == 0) done_.notify_all();
+        }
+    }
+}
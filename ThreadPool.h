@@ -0,0 +1,37 @@
+#pragma once
+
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <queue>
+#include <thread>
+#include <vector>
+
+
+//пул рабочих потоков с общей очередью задач
+class ThreadPool {
+public:
+    explicit ThreadPool(size_t n = 0);  //0 - по числу ядер
+
+    ~ThreadPool();
+
+    void submit(std::function<void()> task);
+
+    void wait();    //дождаться выполнения всех поставленных задач
+
+    size_t size() const;
+
+    ThreadPool(ThreadPool const&) = delete;
+    ThreadPool& operator=(ThreadPool const&) = delete;
+
+private:
+    std::vector<std::thread> workers_;
+    std::queue<std::function<void()>> tasks_;
+    std::mutex mutex_;
+    std::condition_variable has_task_;
+    std::condition_variable done_;
+    size_t active_ = 0;
+    bool stop_ = false;
+
+    void work();
+};
@@ -4,17 +4,15 @@
 #include <utility>
 
 #include "Value.h"
+#include "Context.h"
 #include "basic_HM.h"
 
 
-Func::Func(const Func &f) : argv(f.argv) {
-    local = f.local;
-    body = new Node(*f.body);
+Func::Func(std::vector<std::string> as, name_table nt, Node b) :
+argv(std::move(as)), local(std::move(nt)) {
+    body = Node(&code, code.copy(*b.ast(), b.id()));
 }
 
-Func::Func(std::vector<std::string> as, name_table nt, Node *b) :
-argv(std::move(as)), local(std::move(nt)), body(b) {}
-
 
 Value::BadType::BadType(Type actual, Type expected) {
     msg = "BadType exception: expected " +
@@ -32,6 +30,31 @@ Value::Value(std::array<int, 7> dim) : _type(DOUBLE) {
     _dimension = dim;
 }
 
+MatrixData::MatrixData(Matrix elements) {
+    bool plain = !elements.empty() && !elements[0].empty();
+    const std::array<int, 7> &dim = plain ? elements[0][0]._dimension : Value::dimensionless;
+    for (size_t i = 0; plain && i < elements.size(); ++i) {
+        plain = elements[i].size() == elements[0].size();
+        for (size_t j = 0; plain && j < elements[i].size(); ++j) {
+            plain = elements[i][j]._type == Value::DOUBLE && elements[i][j]._dimension == dim;
+        }
+    }
+    if (!plain) {
+        m = std::move(elements);
+        return;
+    }
+    dense = DenseMatrix(elements.size(), elements[0].size(), dim);
+    for (size_t i = 0; i < dense.rows; ++i) {
+        for (size_t j = 0; j < dense.cols; ++j) {
+            dense.at(i, j) = elements[i][j].get_double();
+        }
+    }
+}
+
+MatrixData::MatrixData(DenseMatrix d) : dense(std::move(d)) {}
+
+MatrixData::MatrixData(const MatrixData &other) : m(other.m), dense(other.dense) {}
+
 Value::Value(double d) : _type(DOUBLE) {
     _double_data = d;
 }
@@ -42,26 +65,20 @@ Value::Value(double d, std::array<int, 7> dim) : _type(DOUBLE) {
 }
 
 Value::Value(Matrix m) : _type(MATRIX) {
-    _matrix_data = new Matrix(m.size());
-    for (size_t i = 0; i < m.size(); ++i) {
-        for (size_t j = 0; j < m[i].size(); ++j) {
-            (*_matrix_data)[i].push_back(Value(m[i][j]));
-        }
-    }
+    _matrix_data = new MatrixData(std::move(m));
 }
 
 Value::Value(Matrix m, std::array<int, 7> dim) : _type(MATRIX) {
     _dimension = dim;
-    _matrix_data = new Matrix(m.size());
-    for (size_t i = 0; i < m.size(); ++i) {
-        for (size_t j = 0; j < m[i].size(); ++j) {
-            (*_matrix_data)[i].push_back(Value(m[i][j]));
-        }
-    }
+    _matrix_data = new MatrixData(std::move(m));
+}
+
+Value::Value(DenseMatrix d) : _type(MATRIX) {
+    _matrix_data = new MatrixData(std::move(d));
 }
 
-Value::Value(Func *f) : _type(FUNCTION) {
-    _function_data = new Func(*f);
+Value::Value(const Func *f) : _type(FUNCTION) {
+    _function_data = f;
 }
 
 Value::Value(const Value &other) : _type(other._type) {
@@ -70,52 +87,77 @@ Value::Value(const Value &other) : _type(other._type) {
         _dimension = other._dimension;
     } else if (_type == MATRIX || _type == INFERRED_MATRIX) {
         _dimension = other._dimension;
-        _matrix_data = new Matrix(other._matrix_data->size());
-        for (size_t i = 0; i < _matrix_data->size(); ++i) {
-            for (size_t j = 0; j < (*other._matrix_data)[i].size(); ++j) {
-                (*_matrix_data)[i].push_back(Value((*other._matrix_data)[i][j]));
-            }
-        }
+        _matrix_data = other._matrix_data;
+        ++_matrix_data->refs;
     } else if (_type == FUNCTION) {
-        _function_data = new Func(*other._function_data);
+        _function_data = other._function_data;
+        ++_function_data->refs;
     }
 }
 
+Value::Value(Value &&other) noexcept : _type(UNDEFINED) {
+    take(other);
+}
+
 Value& Value::operator=(const Value &other) {
 
     if (&other != this) {
-        if (_type == DOUBLE || _type == INFERRED_DOUBLE) {
-            _double_data = 0.0;
-            _dimension.fill(0);
-        } else if (_type == MATRIX || _type == INFERRED_MATRIX) {
-            delete _matrix_data;
-            _dimension.fill(0);
-        } else if (_type == FUNCTION) {
-            delete _function_data;
-        }
-        _type = other._type;
-        if (_type == DOUBLE || _type == INFERRED_DOUBLE) {
-            _dimension = other._dimension;
-            _double_data = other._double_data;
-        } else if (_type == MATRIX || _type == INFERRED_MATRIX) {
-            _dimension = other._dimension;
-            _matrix_data = new Matrix(other._matrix_data->size());
-            for (size_t i = 0; i < _matrix_data->size(); ++i) {
-                for (size_t j = 0; j < (*other._matrix_data)[i].size(); ++j) {
-                    (*_matrix_data)[i].push_back(Value((*other._matrix_data)[i][j]));
-                }
-            }
-        } else if (_type == FUNCTION) {
-            _function_data = new Func(*other._function_data);
-        }
+        Value tmp(other);   //other может быть элементом старой матрицы: ссылка берется до ее освобождения
+        clear();
+        take(tmp);
+    }
+
+    return *this;
+}
+
+Value& Value::operator=(Value &&other) noexcept {
+
+    if (&other != this) {
+        Value tmp(std::move(other));
+        clear();
+        take(tmp);
     }
 
     return *this;
 }
 
 Value::~Value() {
-    if (_type == MATRIX || _type == INFERRED_MATRIX) delete _matrix_data;
-    if (_type == FUNCTION) delete _function_data;
+    clear();
+}
+
+void Value::clear() {
+    if (_type == MATRIX || _type == INFERRED_MATRIX) release(_matrix_data);
+    if (_type == FUNCTION) release(_function_data);
+    _type = UNDEFINED;
+    _dimension.fill(0);
+}
+
+void Value::take(Value &v) {
+    _type = v._type;
+    _dimension = v._dimension;
+    if (_type == DOUBLE || _type == INFERRED_DOUBLE) {
+        _double_data = v._double_data;
+    } else if (_type == MATRIX || _type == INFERRED_MATRIX) {
+        _matrix_data = v._matrix_data;
+    } else if (_type == FUNCTION) {
+        _function_data = v._function_data;
+    }
+    v._type = UNDEFINED;
+}
+
+//не встраивается: иначе GCC проверяет счетчик и во встроенных деструкторах чисел и ложно предупреждает
+#if defined(__GNUC__)
+__attribute__((noinline))
+#endif
+void Value::release(const Func *f) {
+    if (--f->refs == 0) delete f;
+}
+
+#if defined(__GNUC__)
+__attribute__((noinline))
+#endif
+void Value::release(MatrixData *m) {
+    if (--m->refs == 0) delete m;
 }
 
 // Функции ниже в зависимости от типа возвращают значение или бросают исключение
@@ -136,119 +178,166 @@ std::array<int, 7> Value::get_dimension() const {
     return _dimension;
 }
 
-Matrix& Value::get_matrix() const {
+void Value::check_matrix() const {
     if (_type != MATRIX && _type != INFERRED_MATRIX) {
         std::cout << "error in get_matrix()\n";
         throw BadType(_type, MATRIX);
     }
-    return *_matrix_data;
 }
 
-Func* Value::get_function() const {
-    if (_type != FUNCTION) {
-        std::cout << "error in get_function()\n";
-        throw BadType(_type, FUNCTION);
-    }
-    return _function_data;
+size_t Value::rows() const {
+    check_matrix();
+    return _matrix_data->is_dense() ? _matrix_data->dense.rows : _matrix_data->m.size();
 }
 
+size_t Value::cols() const {
+    check_matrix();
+    return _matrix_data->is_dense() ? _matrix_data->dense.cols : _matrix_data->m[0].size();
+}
 
-Replacement::Replacement() :
-tag(PLACEHOLDER), begin(0), end(0), replacement(Value(0.0, Value::dimensionless)) {}
-
-Replacement::Replacement(Tag t, size_t b, size_t e, const Value& v) :
-tag(t), begin(b), end(e), replacement(v) {}
+Value Value::at(size_t i, size_t j) const {
+    check_matrix();
+    if (_matrix_data->is_dense()) {
+        return {_matrix_data->dense.at(i, j), _matrix_data->dense.dim};
+    }
+    return _matrix_data->m[i][j];
+}
 
+void Value::set_at(size_t i, size_t j, Value v) {
+    check_matrix();
+    MatrixData *d = unshare();
+    if (d->is_dense()) {
+        if (v._type == DOUBLE && v._dimension == d->dense.dim) {
+            d->dense.at(i, j) = v._double_data;
+            return;
+        }
+        //элемент другой размерности или не число: матрица переходит в общий вид
+        Type t = _type;
+        std::array<int, 7> dim = _dimension;
+        Matrix m = take_elements();
+        m[i][j] = std::move(v);
+        _matrix_data = new MatrixData(std::move(m));
+        _type = t;
+        _dimension = dim;
+        return;
+    }
+    d->m[i][j] = std::move(v);
+}
 
-Node::Node(Token *t) {
-    _coord = t->start.start;
-    _tag = t->_tag;
-    if (_tag == NUMBER || _tag == IDENT || _tag == KEYWORD || _tag == DIMENSION) {
-        _label = t->raw;
-    } else
-        _label = t->_ident;
-    _priority = t_info[_tag].priority;
+const DenseMatrix *Value::dense() const {
+    if (_type != MATRIX && _type != INFERRED_MATRIX) return nullptr;
+    return _matrix_data->is_dense() ? &_matrix_data->dense : nullptr;
+}
 
-    if (_tag == PLACEHOLDER) {
-        Node::save_rep(_coord, PLACEHOLDER, t->end.index - 2, t->end.index);
-    }
+Value Value::as_matrix(std::array<int, 7> dim) const {
+    check_matrix();
+    Value res(*this);
+    res._type = MATRIX;
+    res._dimension = dim;
+    return res;
 }
 
-void Node::save_rep(const Coordinate& c, Tag t, size_t a, size_t b) {
-    Node::reps[c] = Replacement(t, a, b);
+MatrixData *Value::unshare() {
+    if (_matrix_data->refs != 1) {
+        MatrixData *copy = new MatrixData(*_matrix_data);
+        release(_matrix_data);
+        _matrix_data = copy;
+    }
+    return _matrix_data;
 }
 
-void Node::copy_defs(name_table &local, name_table *ptr) {
-    if (ptr) local.insert(ptr->begin(), ptr->end());
-    else local.insert(global.begin(), global.end());
+DenseMatrix &Value::own_dense() {
+    return unshare()->dense;
 }
 
-Value &Node::lookup(const std::string& name, name_table *ptr, const Coordinate& pos) {
-    if (ptr) {
-        auto res = ptr->find(name);
-        if (res != ptr->end()) {
-            return res->second;
+Matrix Value::take_elements() {
+    check_matrix();
+    Matrix res;
+    if (!_matrix_data->is_dense()) {
+        res = (_matrix_data->refs == 1) ? std::move(_matrix_data->m) : _matrix_data->m;
+    } else {
+        const DenseMatrix &d = _matrix_data->dense;
+        res.resize(d.rows);
+        for (size_t i = 0; i < d.rows; ++i) {
+            res[i].reserve(d.cols);
+            for (size_t j = 0; j < d.cols; ++j) {
+                res[i].emplace_back(d.at(i, j), d.dim);
+            }
         }
     }
-    auto res = global.find(name);
-    if (res != global.end()) {
-        return res->second;
-    }
-    throw Error(pos, "Undefined variable reference");
+    clear();
+    return res;
 }
 
-void Node::def(const std::string& name, const Value& val, name_table *ptr) {
-//    std::cout << "def is invoked for name = " << name << "\n";
-    if (ptr) {
-        auto res = global.find(name);
-        if (res == global.end()) {
-            (*ptr)[name] = val;
-            return;
-        }
+const Func* Value::get_function() const {
+    if (_type != FUNCTION) {
+        std::cout << "error in get_function()\n";
+        throw BadType(_type, FUNCTION);
     }
-    global[name] = val;
+    return _function_data;
+}
+
+
+Replacement::Replacement() :
+tag(PLACEHOLDER), begin(0), end(0), replacement(Value(0.0, Value::dimensionless)) {}
+
+Replacement::Replacement(Tag t, size_t b, size_t e, Value v) :
+tag(t), begin(b), end(e), replacement(std::move(v)) {}
+
+
+void Parser::save_rep(const Coordinate& c, Tag t, size_t a, size_t b) {
+    (*reps)[c] = Replacement(t, a, b);
 }
 
 // Семантический анализ (проверка размерностей)
-void Node::semantic_analysis() {
-    if (_tag == ROOT) {
-        for (auto & field : fields) {
-            field->semantic_analysis();
+void Node::semantic_analysis(Context &ctx) const {
+    if (get_tag() == ROOT) {
+        for (auto field : fields()) {
+            field.semantic_analysis(ctx);
         }
     } else {
-        analyse(this, false, {}, false);
+        analyse(ctx, *this, false, {}, false);
     }
 }
 
-Value Node::exec(name_table *scope = nullptr) {
-    if (_tag == NUMBER) {   //если это NUMBER, то в _label записана строка с числом
-        double val = std::stod(this->_label);
+Value Node::exec(Context &ctx, Frame *scope) const {
+    Tag _tag = get_tag();
+    const std::string& _label = get_label();
+    const Coordinate& _coord = coord();
+    Node left = this->left();
+    Node right = this->right();
+    Node cond = this->cond();
+    NodeList fields = this->fields();
+
+    if (_tag == NUMBER) {   //если это NUMBER, то число уже разобрано из _label при построении дерева
+        double val = number();
+        if (std::isnan(val)) val = std::stod(_label);   //не число: ошибку выдаст stod
         return {val, Value::dimensionless};
     }
     else if (_tag == BEGINM) {  //это матрица, нужно собрать из полей Matrix
         Matrix m;   //при построении проверяется, что матрица прямоугольная и как минимум 1 х 1, поэтому здесь проверки не нужны
-        for (auto & field : fields) {   //цикл по строкам
+        for (auto field : fields) {   //цикл по строкам
             std::vector<Value> v;
-            for (auto & jt : field->fields) { //цикл по элементам строк
-                v.push_back(jt->exec(scope));
+            v.reserve(field.fields().size());
+            for (auto jt : field.fields()) { //цикл по элементам строк
+                v.push_back(jt.exec(ctx, scope));
             }
-            m.push_back(v);
+            m.push_back(std::move(v));
         }
-        return {m};
+        return {std::move(m)};
     }
     else if (_tag == IDENT) {   //переменная
-        Value x_val = Node::lookup(_label, scope, _coord);
+        Value x_val = ctx.lookup(_label, scope, _coord);     //матрица не копируется, только ссылка на нее
         size_t sz = fields.size();
         if (sz == 0) {  //обычная переменная
             return x_val;
         } else {
-            Matrix *m = &x_val.get_matrix();
-            size_t ver = (*m).size();
-            size_t hor = (*m)[0].size();
+            size_t ver = x_val.rows();
+            size_t hor = x_val.cols();
 
-            int int_i = (int) fields[0]->exec(scope).get_double();
+            int int_i = (int) fields[0].exec(ctx, scope).get_double();
             if (int_i < 0) {
-                throw Error(left->_coord, "Negative index");
+                throw Error(left.coord(), "Negative index");
             }
             size_t i = int_i;
             size_t j = 0;
@@ -262,53 +351,53 @@ Value Node::exec(name_table *scope = nullptr) {
                     throw Error(_coord, "Can't use vector index for matrix");
                 }
             } else if (sz == 2) { //элемент матрицы
-                int int_j = (int) fields[1]->exec(scope).get_double();
+                int int_j = (int) fields[1].exec(ctx, scope).get_double();
                 if (int_j < 0) {
-                    throw Error(left->_coord, "Negative index");
+                    throw Error(left.coord(), "Negative index");
                 }
                 j = int_j;
             }
             if (i >= ver || j >= hor) {
                 throw Error(_coord, "Index is out of range");
             }
-            return (*m)[i][j];
+            return x_val.at(i, j);
         }
 
     }
     else if (_tag == FUNC) {  //вызов функции
         //область видимости переменных -- функция
-        Value f_val = Node::lookup(_label, scope, _coord);
-        Func *f = f_val.get_function();
+        Value f_val = ctx.lookup(_label, scope, _coord);   //копия держит функцию, пока идет вызов
+        const Func *f = f_val.get_function();
         //загрузка значений имен переменных
         size_t f_s = fields.size();
         std::vector<Value> args;
+        args.reserve(f_s);
         for (size_t i = 0; i < f_s; ++i) {
-            args.push_back(fields[i]->exec(scope));
+            args.push_back(fields[i].exec(ctx, scope));
         }
-        return Value::call(f_val, args, _coord);
+        return Value::call(ctx, *f, std::move(args), _coord);
     }
     else if (_tag == UADD || _tag == LPAREN) {
-        return right->exec(scope);
+        return right.exec(ctx, scope);
     }
     else if (_tag == USUB) {
-        return Value::usub(right->exec(scope), _coord);
+        return Value::usub(right.exec(ctx, scope), _coord);
     }
     else if (_tag == NOT) {
-        return Value::eq(right->exec(scope), Value(0.0, Value::dimensionless), _coord);
+        return Value::eq(right.exec(ctx, scope), Value(0.0, Value::dimensionless), _coord);
     }
     else if (_tag == SET) {
-        if (left->_tag == IDENT) {
-            size_t sz = left->fields.size();
+        if (left.get_tag() == IDENT) {
+            size_t sz = left.fields().size();
             if (sz == 0) {    //переменная
-                Node::def(left->_label, right->exec(scope), scope);
+                ctx.def(left.get_label(), right.exec(ctx, scope), scope);
             } else {    //матрица
-                Value *m_val = &Node::lookup(left->_label, scope, left->_coord);
-                Matrix *m = &m_val->get_matrix();
-                size_t ver = (*m).size();
-                size_t hor = (*m)[0].size();
-                int int_i = (int) left->fields[0]->exec(scope).get_double();
+                Value *m_val = &ctx.change(left.get_label(), scope, left.coord());
+                size_t ver = m_val->rows();
+                size_t hor = m_val->cols();
+                int int_i = (int) left.fields()[0].exec(ctx, scope).get_double();
                 if (int_i < 0) {
-                    throw Error(left->_coord, "Negative index");
+                    throw Error(left.coord(), "Negative index");
                 }
                 size_t i = int_i;
                 size_t j = 0;
@@ -320,9 +409,9 @@ Value Node::exec(name_table *scope = nullptr) {
                         throw Error(_coord, "Bad index");
                     }
                 } else if (sz == 2) { //элемент матрицы
-                    int int_j = (int) left->fields[1]->exec(scope).get_double();
+                    int int_j = (int) left.fields()[1].exec(ctx, scope).get_double();
                     if (int_j < 0) {
-                        throw Error(left->_coord, "Negative index");
+                        throw Error(left.coord(), "Negative index");
                     }
                     j = int_j;
                 } else {
@@ -331,200 +420,243 @@ Value Node::exec(name_table *scope = nullptr) {
                 if (i >= ver || j >= hor) {
                     throw Error(_coord, "Index is out of range");
                 }
-                (*m)[i][j] = right->exec(scope);
+                //правая часть может сохранить копию матрицы или присвоить переменной другое значение,
+                //поэтому свои элементы берутся только после ее вычисления
+                Value r = right.exec(ctx, scope);
+                if (i >= m_val->rows() || j >= m_val->cols()) {
+                    throw Error(_coord, "Index is out of range");
+                }
+                m_val->set_at(i, j, std::move(r));
                 return {0.0, Value::dimensionless};
             }
         }
-        else if (left->_tag == FUNC) { //функция
+        else if (left.get_tag() == FUNC) { //функция
             std::vector<std::string> ns;
             //список аргументов функции
             //при объявлении функции допустимы только IDENT в списке аргументов
-            for (auto it = left->fields.begin(); it < left->fields.end(); ++it) {
-                ns.push_back((*it)->_label);
+            for (auto arg : left.fields()) {
+                ns.push_back(arg.get_label());
             }
             //если функция объявляется глобально, ссылаться на Node из дерева нельзя
-            //т.к. для каждого блока preproc строится новое, а старое удаляется
-            Node *copy_of_right = new Node(*right);
-            Func *f = (scope) ? new Func(ns, *scope, copy_of_right) : new Func(ns, global, copy_of_right);
-            Value func_v = Value(f);
-            Node::def(left->_label, func_v, scope);
+            //т.к. для каждого блока preproc строится новое, а старое удаляется, поэтому Func копирует тело
+            name_table env;
+            ctx.capture(right, ns, scope, env);
+            ctx.def(left.get_label(), Value(new Func(std::move(ns), std::move(env), right)), scope);
         } else {
             throw Error(_coord, "Can't define this");
         }
     }
     else if (_tag == ADD) {
-        return Value::plus(left->exec(scope), right->exec(scope), _coord);
+        //операнды слева направо, как в Vm: вызов функции в правом операнде может изменить имя из левого
+        Value l = left.exec(ctx, scope);
+        Value r = right.exec(ctx, scope);
+        return Value::plus(std::move(l), r, _coord);
     }
     else if (_tag == SUB) {
-        return Value::sub(left->exec(scope), right->exec(scope), _coord);
+        Value l = left.exec(ctx, scope);
+        Value r = right.exec(ctx, scope);
+        return Value::sub(std::move(l), r, _coord);
     }
     else if (_tag == MUL) {
-        return Value::mul(left->exec(scope), right->exec(scope), _coord);
+        Value l = left.exec(ctx, scope);
+        Value r = right.exec(ctx, scope);
+        return Value::mul(std::move(l), std::move(r), _coord);
     }
     else if (_tag == DIV || _tag == FRAC) {
-        return Value::div(left->exec(scope), right->exec(scope), _coord);
+        Value l = left.exec(ctx, scope);
+        Value r = right.exec(ctx, scope);
+        return Value::div(std::move(l), r, _coord);
     }
     else if (_tag == POW) {
-        return Value::pow(left->exec(scope), right->exec(scope), _coord);
+        Value l = left.exec(ctx, scope);
+        Value r = right.exec(ctx, scope);
+        return Value::pow(l, r, _coord);
     }
     else if (_tag == ABS) {
-        return Value::abs(right->exec(scope), _coord);
+        return Value::abs(right.exec(ctx, scope), _coord);
     }
     else if (_tag == EQ) {
-        Value res = left->exec(scope);
-        if (right->_tag == PLACEHOLDER) {
-            reps[right->_coord].replacement = res;
+        Value res = left.exec(ctx, scope);
+        if (right.get_tag() == PLACEHOLDER) {
+            ctx.reps[right.coord()].replacement = std::move(res);
             return {1.0, Value::dimensionless}; //равенство выполняется, вернуть 1 - нормально
-        } else if (right->left != nullptr && right->left->_tag == PLACEHOLDER) {
-            Value r = Value::div(res, right->right->exec(scope), _coord);
-            reps[right->_coord].replacement = r;
+        } else if (right.left() && right.left().get_tag() == PLACEHOLDER) {
+            ctx.reps[right.coord()].replacement = Value::div(std::move(res), right.right().exec(ctx, scope), _coord);
             return {1.0, Value::dimensionless}; //равенство выполняется, вернуть 1 - нормально
         }
-        return Value::eq(res, right->exec(scope), _coord);
+        return Value::eq(res, right.exec(ctx, scope), _coord);
     }
     else if (_tag == NEQ) {
-        return {
-            static_cast<double>(
-                !Value::eq(left->exec(scope), right->exec(scope), _coord).get_double()
-            )
-        };
+        Value l = left.exec(ctx, scope);
+        Value r = right.exec(ctx, scope);
+        return {static_cast<double>(!Value::eq(l, r, _coord).get_double())};
     }
     else if (_tag == LEQ) {
-        return Value::le(left->exec(scope), right->exec(scope), _coord);
+        Value l = left.exec(ctx, scope);
+        Value r = right.exec(ctx, scope);
+        return Value::le(l, r, _coord);
     }
     else if (_tag == GEQ) {
-        return Value::ge(left->exec(scope), right->exec(scope), _coord);
+        Value l = left.exec(ctx, scope);
+        Value r = right.exec(ctx, scope);
+        return Value::ge(l, r, _coord);
     }
     else if (_tag == LT) {
-        return Value::lt(left->exec(scope), right->exec(scope), _coord);
+        Value l = left.exec(ctx, scope);
+        Value r = right.exec(ctx, scope);
+        return Value::lt(l, r, _coord);
     }
     else if (_tag == GT) {
-        return Value::gt(left->exec(scope), right->exec(scope), _coord);
+        Value l = left.exec(ctx, scope);
+        Value r = right.exec(ctx, scope);
+        return Value::gt(l, r, _coord);
     }
     else if (_tag == AND) {
-        return Value::andd(left->exec(scope), right->exec(scope), _coord);
+        Value l = left.exec(ctx, scope);
+        Value r = right.exec(ctx, scope);
+        return Value::andd(l, r, _coord);
     }
     else if (_tag == OR) {
-        return Value::orr(left->exec(scope), right->exec(scope), _coord);
+        Value l = left.exec(ctx, scope);
+        Value r = right.exec(ctx, scope);
+        return Value::orr(l, r, _coord);
     }
     else if (_tag == ROOT) {
         Value res(0.0);
-        for (auto & field : fields) {
-            res = field->exec(scope);
+        for (auto field : fields) {
+            res = field.exec(ctx, scope);
         }
         return res;
     }
     else if (_tag == BEGINB) {
         Value res(0.0);
-        for (auto & field : fields) {
-            res = field->exec(scope);
+        for (auto field : fields) {
+            res = field.exec(ctx, scope);
         }
         return res;
     }
     else if (_tag == BEGINC) {
-        for (auto & field : fields) {
-            if (!field->cond || field->cond->exec(scope).get_double() == 1.0) {
-                return field->right->exec(scope);
+        for (auto field : fields) {
+            if (!field.cond() || field.cond().exec(ctx, scope).get_double() == 1.0) {
+                return field.right().exec(ctx, scope);
             }
         }
     }
     else if (_tag == IF) {
-        Value c_val = cond->exec(scope);
+        Value c_val = cond.exec(ctx, scope);
         if (c_val.get_double()) {
-            return right->exec(scope);
+            return right.exec(ctx, scope);
         }
         else if (left) {
-            return left->exec(scope);
+            return left.exec(ctx, scope);
         }
     }
     else if (_tag == WHILE) {
         Value res(0.0);
-        while (cond->exec(scope).get_double() == 1.0) {
-            res = right->exec(scope);
+        while (cond.exec(ctx, scope).get_double() == 1.0) {
+            res = right.exec(ctx, scope);
         }
         return res;
     }
-    else if (_tag == PRODUCT) {
-        Value res(0.0);
-        while (cond->exec(scope).get_double() == 1.0) {
-            res = right->exec(scope);
+    else if (_tag == SUM || _tag == PRODUCT) {
+        //границы вычисляются один раз; счетчик пишется прямо в значение переменной,
+        //а накопитель - локальное значение, а не имя в таблице
+        Node var = left.left();
+        double x = left.right().exec(ctx, scope).get_double();
+        double to = cond.exec(ctx, scope).get_double();
+        Value *counter = &ctx.counter(var.get_label(), scope);
+        Value res;  //первое слагаемое задает размерность, поэтому начального 0 или 1 нет
+        for (; x <= to; x += 1.0) {
+            *counter = Value(x, Value::dimensionless);
+            Value term = right.exec(ctx, scope);
+            if (res._type == Value::UNDEFINED) res = std::move(term);
+            else if (_tag == SUM) res = Value::plus(std::move(res), term, _coord);
+            else res = Value::mul(std::move(res), std::move(term), _coord);
         }
+        *counter = Value(x, Value::dimensionless);     //после цикла переменная на шаг за верхней границей
+        if (res._type == Value::UNDEFINED) return {_tag == SUM ? 0.0 : 1.0, Value::dimensionless};
         return res;
     }
     else if (_tag == TRANSP) {
-        return Value::transpose(left->exec(scope));
+        return Value::transpose(left.exec(ctx, scope));
     }
     else if (_tag == RANGE) {
-        std::vector<Value> row;
-        double a = left->exec(scope).get_double();
-        double b = right->exec(scope).get_double();
-        double d = (cond) ? Value(cond->exec(scope)).get_double() : 0.1;
+        DenseMatrix row(1, 0, Value::dimensionless);
+        double a = left.exec(ctx, scope).get_double();
+        double b = right.exec(ctx, scope).get_double();
+        double d = (cond) ? Value(cond.exec(ctx, scope)).get_double() : 0.1;
         for (double x = a; x <= b; x += d) {
-            row.emplace_back(x);
+            row.data.push_back(x);
         }
-        if (row.empty()) {
+        if (row.data.empty()) {
             throw Error(_coord, "Empty range");
         }
-        Matrix m;
-        m.push_back(row);
-        return {m};
+        row.cols = row.data.size();
+        return Value(std::move(row));
     }
     else if (_tag == GRAPHIC) {
-        Value func_v = Node::lookup(_label, scope, _coord);
-        Func *func = func_v.get_function();
+        Value func_v = ctx.lookup(_label, scope, _coord);
+        const Func *func = func_v.get_function();
         size_t sz = func->argv.size();
         std::vector<Value> args(sz);
         size_t ivar = 0;    //номер переменного аргумента
         bool found = false;
         for (size_t i = 0; i < sz; ++i) {
-            if (fields[i]->_tag == RANGE) {
+            if (fields[i].get_tag() == RANGE) {
                 if (!found) {
                     ivar = i;
                     found = true;
                 } else {
-                    throw Error(fields[i]->_coord, "More than one parameter range");
+                    throw Error(fields[i].coord(), "More than one parameter range");
                 }
             } else {
-                args[i] = fields[i]->exec(scope);
+                args[i] = fields[i].exec(ctx, scope);
             }
         }
         if (!found) {
             throw Error(_coord, "No range parameter");
         }
-        Value range_v = fields[ivar]->exec(scope);
-        Matrix *range = &range_v.get_matrix();
-
+        Value range_v = fields[ivar].exec(ctx, scope);
+        size_t n = range_v.cols();
+        //точки (x, f(x)) - числа без размерности, если такова область; иначе - общий вид
+        const DenseMatrix *xs = range_v.dense();
+        bool plain = xs && xs->dim == Value::dimensionless;
+        DenseMatrix points(plain ? n : 0, 2, Value::dimensionless);
         Matrix plot;
-        for (auto & it : (*range)[0]) {
-            args[ivar] = it;
-            double fx = Value::call(func, args, _coord).get_double();
-            std::vector<Value> point = {it, Value(fx)};
-            plot.push_back(point);
+        for (size_t k = 0; k < n; ++k) {
+            Value x = range_v.at(0, k);
+            args[ivar] = x;
+            double fx = Value::call(ctx, *func, args, _coord).get_double();
+            if (plain) {
+                points.at(k, 0) = xs->at(0, k);
+                points.at(k, 1) = fx;
+            } else {
+                plot.push_back({x, Value(fx)});
+            }
         }
-        Value graphic(plot);
-        Node::reps[_coord].replacement = graphic;
+        ctx.reps[_coord].replacement = plain ? Value(std::move(points)) : Value(std::move(plot));
     }
     else if (_tag == KEYWORD) {
-        auto res = constants.find(_label);
-        if (res != constants.end()) {
-            return {res->second};
+        const double *res = constants.find(_label);
+        if (res) {
+            return {*res};
         } else {
-            auto result = arg_count.find(_label);
-            if (result == arg_count.end()) {
+            const int *result = arg_count.find(_label);
+            if (!result) {
                 throw Error(_coord, "Keyword is not defined");
             }
-            int argc = result->second;
+            int argc = *result;
             if (fields.size() != argc) {
                 throw Error(_coord, "Wrong argument number");
             }
             std::vector<Value> args;
-            for (auto & field : fields) {
-                Value val = field->exec(scope);    //эти функции не принимают только double-ы
-                args.push_back(val);
+            args.reserve(fields.size());
+            for (auto field : fields) {
+                args.push_back(field.exec(ctx, scope));    //эти функции не принимают только double-ы
             }
             if (argc == 1) {
                 if (_label == "\\floor" || Value::is_dimensionless(args[0])) {
-                    return {funcs1[_label](args[0].get_double()), args[0].get_dimension()};
+                    return {(*funcs1.find(_label))(args[0].get_double()), args[0].get_dimension()};
                 } else {
                     std::string error = _label + " gets only dimensionless argument";
                     throw Error(_coord, error);
@@ -535,8 +667,7 @@ Value Node::exec(name_table *scope = nullptr) {
         }
     }
     else if (_tag == DIMENSION) {
-        auto res = dimensions.find(_label);
-        return {res->second};
+        return {*dimensions.find(_label)};
     }
 
     return {0.0, Value::dimensionless};
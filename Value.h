@@ -5,23 +5,59 @@
 #include <sstream>
 #include <iomanip>
 #include <algorithm>
+#include <atomic>
+#include <memory>
+#include <mutex>
 #include <utility>
 #include "Node.h"
 #include "Error.h"
+#include "DenseMatrix.h"
 
 
+struct Chunk;
+
+//функция после определения не меняется, поэтому копии Value делят один объект со счетчиком ссылок.
+//Вызов пишет аргументы не в local, а в свой кадр, так что вызовы из разных потоков и рекурсия независимы
 typedef struct Func {
     std::vector<std::string> argv;
-    name_table local;
-    Node* body;
+    name_table local;       //окружение, захваченное при определении
+    Ast code;       //своя копия тела
+    Node body;      //корень тела в code
+    mutable std::shared_ptr<const Chunk> chunk;     //тело, скомпилированное для Vm при первом вызове
+    mutable std::once_flag compiled;
+    mutable std::atomic<size_t> refs{1};
 
-    Func(const Func &f);
+    Func(const Func &f) = delete;
 
-    Func(std::vector<std::string> as, name_table nt, Node *b);
+    Func(std::vector<std::string> as, name_table nt, Node b);
 } Func;
 
+//кадр вызова функции: аргументы и имена, которым присвоило значение тело. Остальные имена
+//читаются из окружения функции, при вызове оно не копируется
+typedef struct Frame {
+    name_table vars;
+    const name_table *env;
+} Frame;
+
 typedef std::vector<std::vector<Value>> Matrix;
 
+//элементы матрицы общие для всех копий Value; свою копию получает только значение,
+//элемент которого меняется (set_at). Числа одной размерности хранятся плотно (dense),
+//элементы разной размерности и не числа - в общем виде m
+typedef struct MatrixData {
+    Matrix m;           //пуст, если матрица плотная
+    DenseMatrix dense;
+    std::atomic<size_t> refs{1};
+
+    explicit MatrixData(Matrix elements);   //плотная, если все элементы - DOUBLE одной размерности
+
+    explicit MatrixData(DenseMatrix d);
+
+    MatrixData(const MatrixData &other);
+
+    bool is_dense() const { return m.empty(); }
+} MatrixData;
+
 class Value {
 public:
     typedef enum Type {
@@ -62,21 +98,46 @@ public:
     };
 
 private:
+    friend class Vm;    //арифметика машины пишет числа прямо в регистры
+
     union {
         double _double_data;
-        std::vector<std::vector<Value>> *_matrix_data;
-        Func *_function_data;
+        MatrixData *_matrix_data;
+        const Func *_function_data;
     };
 
+    static void release(const Func *f);     //последняя ссылка удаляет функцию
+
+    static void release(MatrixData *m);
+
+    void check_matrix() const;
+
+    MatrixData *unshare();  //своя копия данных матрицы, если они общие
+
+    DenseMatrix &own_dense();
+
+    Matrix take_elements();     //элементы в общем виде; значение становится UNDEFINED
+
+    //результат операции, записанный в элементы операнда: тип и размерность как у новой матрицы
+    static Value fresh(Value v) {
+        v._type = MATRIX;
+        v._dimension = dimensionless;
+        return v;
+    }
+
+    void clear();   //освободить данные, значение становится UNDEFINED
+
+    void take(Value &v);    //забрать данные v, v становится UNDEFINED
+
 public:
 
-    static Value call(const Value &arg, std::vector<Value> arguments, const Coordinate& pos) {
-        Func *f = arg.get_function();
-        size_t sz = f->argv.size();
+    static Value call(Context &ctx, const Func &f, std::vector<Value> arguments, const Coordinate& pos) {
+        Frame frame{{}, &f.local};
+        size_t sz = f.argv.size();
         for (size_t i = 0; i < sz; ++i) {
-            f->local[f->argv[i]] = arguments[i];
+            frame.vars[f.argv[i]] = std::move(arguments[i]);
         }
-        return f->body->exec(&f->local);
+        return f.body.exec(ctx, &frame);
     }
 
     Value();
@@ -91,21 +152,26 @@ public:
 
     Value(Matrix m, std::array<int, 7> dim);
 
-    Value(Func *f);
+    explicit Value(DenseMatrix d);
+
+    explicit Value(const Func *f);  //значение становится владельцем новой функции
 
     Value(const Value &other);
 
+    Value(Value &&other) noexcept;
+
     Value &operator=(const Value &other);
 
+    Value &operator=(Value &&other) noexcept;
+
     ~Value();
 
     friend std::string to_plot(const Value &matr) {
         if (matr._type == MATRIX || matr._type == INFERRED_MATRIX) {
             std::string res;
-            Matrix *m = &matr.get_matrix();
-            for (auto & it : *m) {
-                res += "(" + std::to_string(it[0].get_double()) + ","
-                       + std::to_string(it[1].get_double()) + ")\n";
+            for (size_t i = 0; i < matr.rows(); ++i) {
+                res += "(" + std::to_string(matr.at(i, 0).get_double()) + ","
+                       + std::to_string(matr.at(i, 1).get_double()) + ")\n";
             }
             return res;
         }
@@ -427,9 +493,23 @@ public:
         if (val._type == DOUBLE || val._type == INFERRED_DOUBLE) {
             return double_to_String(val._double_data) + getDimension_in_frac(val);
         }
+        if ((val._type == MATRIX || val._type == INFERRED_MATRIX) && val._matrix_data->is_dense()) {
+            const DenseMatrix &d = val._matrix_data->dense;
+            std::string unit = getDimension_in_frac(Value(0.0, d.dim));     //у всех элементов одна
+            std::string res = "\\begin{pmatrix}\n";
+            for (size_t i = 0; i < d.rows; ++i) {
+                for (size_t j = 0; j < d.cols; ++j) {
+                    if (j > 0) res += " & ";
+                    res += double_to_String(d.at(i, j)) + unit;
+                }
+                if (i + 1 < d.rows) res += "\\\\\n";
+            }
+            res += "\\end{pmatrix}";
+            return res;
+        }
         if (val._type == MATRIX || val._type == INFERRED_MATRIX) {
             std::string res = "\\begin{pmatrix}\n";
-            for (auto it = (*val._matrix_data).begin();;) {
+            for (auto it = val._matrix_data->m.begin();;) {
                 auto jt = (*it).begin();
                 res += to_string(*jt);
                 ++jt;
@@ -438,7 +518,7 @@ public:
                     res += to_string(*jt);
                 }
                 ++it;
-                if (it != (*val._matrix_data).end()) {
+                if (it != val._matrix_data->m.end()) {
                     res += "\\\\\n";
                 } else break;
             }
@@ -459,9 +539,19 @@ public:
 
     std::array<int, 7> get_dimension() const;
 
-    Matrix& get_matrix() const;
+    size_t rows() const;    //размеры матрицы; у остальных типов - BadType
+
+    size_t cols() const;
+
+    Value at(size_t i, size_t j) const;     //элемент матрицы, индексы уже проверены
+
+    void set_at(size_t i, size_t j, Value v);   //общие с другими значениями элементы сначала копируются
 
-    Func* get_function() const;
+    const DenseMatrix *dense() const;   //плотное представление матрицы или nullptr
+
+    Value as_matrix(std::array<int, 7> dim = dimensionless) const;  //MATRIX с теми же (общими) элементами
+
+    const Func* get_function() const;
 
     static bool is_equal_dim(const Value &left, const Value &right) {
         for (int i = 0; i < 7; i++) {
@@ -481,20 +571,25 @@ public:
         return true;
     }
 
-    static Value plus(const Value &left, const Value &right, const Coordinate& pos) {
+    //левый операнд принимается по значению: у временного значения (или единственной копии)
+    //элементы матрицы не копируются, результат пишется прямо в них.
+    //Плотные матрицы складываются циклом по буферу, остальные - поэлементно
+    static Value plus(Value left, const Value &right, const Coordinate& pos) {
         if (left._type == DOUBLE || left._type == INFERRED_DOUBLE) { //если right - не DOUBLE, сработает исключение
             return {left.get_double() + right.get_double(), left._dimension};
         } else if (left._type == MATRIX || left._type == INFERRED_MATRIX) {
-            Matrix *l = &left.get_matrix();
-            Matrix *r = &right.get_matrix();
-            if ((*l).size() == (*r).size() && (*l)[0].size() == (*r)[0].size()) {
-                Matrix sum(l->size());
-                for (size_t i = 0; i < (*l).size(); ++i) {
-                    for (size_t j = 0; j < (*l)[0].size(); ++j) {
-                        sum[i].push_back(plus((*l)[i][j], (*r)[i][j], pos));
+            if (left.rows() == right.rows() && left.cols() == right.cols()) {
+                if (left.dense() && right.dense()) {
+                    left.own_dense().add(*right.dense());
+                    return fresh(std::move(left));
+                }
+                Matrix sum = left.take_elements();
+                for (size_t i = 0; i < sum.size(); ++i) {
+                    for (size_t j = 0; j < sum[0].size(); ++j) {
+                        sum[i][j] = plus(std::move(sum[i][j]), right.at(i, j), pos);
                     }
                 }
-                return {sum};
+                return {std::move(sum)};
             } else {
                 throw Error(pos, "Matrix dimensions mismatch");
             }
@@ -502,36 +597,41 @@ public:
         throw Error(pos, "Addition cannot be done");
     }
 
-    static Value usub(const Value &arg, const Coordinate& pos) {
+    static Value usub(Value arg, const Coordinate& pos) {
         if (arg._type == DOUBLE || arg._type == INFERRED_DOUBLE) {
             return {-arg.get_double(), arg._dimension};
         } else if (arg._type == MATRIX || arg._type == INFERRED_MATRIX) {
-            Matrix *a = &arg.get_matrix();
-            Matrix res(a->size());
-            for (size_t i = 0; i < res.size(); ++i) {
-                for (size_t j = 0; j < res[i].size(); ++j) {
-                    res[i].push_back(usub((*a)[i][j], pos));
+            if (arg.dense()) {
+                arg.own_dense().negate();
+                return fresh(std::move(arg));
+            }
+            Matrix res = arg.take_elements();
+            for (auto &row : res) {
+                for (auto &x : row) {
+                    x = usub(std::move(x), pos);
                 }
             }
-            return {res};
+            return {std::move(res)};
         }
         throw Error(pos, "Substitution cannot be done");
     }
 
-    static Value sub(const Value &left, const Value &right, const Coordinate& pos) {
+    static Value sub(Value left, const Value &right, const Coordinate& pos) {
         if (left._type == DOUBLE || left._type == INFERRED_DOUBLE) {
             return {left.get_double() - right.get_double(), left._dimension};
         } else if (left._type == MATRIX || left._type == INFERRED_MATRIX) {
-            Matrix *l = &left.get_matrix();
-            Matrix *r = &right.get_matrix();
-            if ((*l).size() == (*r).size() && (*l)[0].size() == (*r)[0].size()) {
-                Matrix dif(l->size());
-                for (size_t i = 0; i < (*l).size(); ++i) {
-                    for (size_t j = 0; j < (*l)[0].size(); ++j) {
-                        dif[i].push_back(sub((*l)[i][j], (*r)[i][j], pos));
+            if (left.rows() == right.rows() && left.cols() == right.cols()) {
+                if (left.dense() && right.dense()) {
+                    left.own_dense().sub(*right.dense());
+                    return fresh(std::move(left));
+                }
+                Matrix dif = left.take_elements();
+                for (size_t i = 0; i < dif.size(); ++i) {
+                    for (size_t j = 0; j < dif[0].size(); ++j) {
+                        dif[i][j] = sub(std::move(dif[i][j]), right.at(i, j), pos);
                     }
                 }
-                return {dif};
+                return {std::move(dif)};
             } else {
                 throw Error(pos, "Matrix dimensions mismatch");
             }
@@ -539,7 +639,8 @@ public:
         throw Error(pos, "Substitution cannot be done");
     }
 
-    static Value mul(const Value &left, const Value &right, const Coordinate& pos) {
+    //произведение числа на матрицу пишется в элементы матрицы, если она временная
+    static Value mul(Value left, Value right, const Coordinate& pos) {
         if (left._type == DOUBLE || left._type == INFERRED_DOUBLE) {
             if (right._type == DOUBLE || right._type == INFERRED_DOUBLE) {
                 std::array<int, 7> dim{};
@@ -549,47 +650,56 @@ public:
                 return {left.get_double() * right.get_double(), dim};
 
             } else if (right._type == MATRIX || right._type == INFERRED_MATRIX) {
-                Matrix *r = &right.get_matrix();
-                Matrix mult((*r).size());
-                for (size_t i = 0; i < (*r).size(); ++i) {
-                    for (size_t j = 0; j < (*r)[0].size(); ++j) {
-                        mult[i].push_back(mul(left, (*r)[i][j], pos));
+                if (right.dense()) {
+                    DenseMatrix &d = right.own_dense();
+                    d.scale(left.get_double());
+                    d.dim = sum_dimensions(left._dimension, d.dim);
+                    return fresh(std::move(right));
+                }
+                Matrix mult = right.take_elements();
+                for (size_t i = 0; i < mult.size(); ++i) {
+                    for (size_t j = 0; j < mult[0].size(); ++j) {
+                        mult[i][j] = mul(left, std::move(mult[i][j]), pos);
                     }
                 }
-                return {mult};
+                return {std::move(mult)};
             }
         } else if (left._type == MATRIX || left._type == INFERRED_MATRIX) {
             if (right._type == DOUBLE || right._type == INFERRED_DOUBLE) {
-                return mul(right, left, pos);
+                return mul(std::move(right), std::move(left), pos);
             } else if (right._type == MATRIX || right._type == INFERRED_MATRIX) {
-                Matrix *l = &left.get_matrix();
-                Matrix *r = &right.get_matrix();
-                size_t l_hor = (*l)[0].size();
-                size_t l_vert = (*l).size();
-                size_t r_vert = (*r).size();
-                size_t r_hor = (*r)[0].size();
+                size_t l_hor = left.cols();
+                size_t l_vert = left.rows();
+                size_t r_vert = right.rows();
+                size_t r_hor = right.cols();
 
                 if (l_hor == r_vert) {
-                    Matrix mult((*l).size());
+                    if (left.dense() && right.dense()) {
+                        return Value(left.dense()->mul(*right.dense()));
+                    }
+                    Matrix l = left.take_elements();
+                    Matrix r = right.take_elements();
+                    Matrix mult(l_vert);
                     for (size_t i = 0; i < l_vert; ++i) {
+                        mult[i].reserve(r_hor);
                         for (size_t j = 0; j < r_hor; ++j) {
-                            Value tmp = mul((*l)[i][0], (*r)[0][j], pos);
-                            for (size_t k = 1; k < (*r).size(); ++k) {
-                                tmp = plus(tmp, mul((*l)[i][k], (*r)[k][j], pos), pos);
+                            Value tmp = mul(l[i][0], r[0][j], pos);
+                            for (size_t k = 1; k < r.size(); ++k) {
+                                tmp = plus(std::move(tmp), mul(l[i][k], r[k][j], pos), pos);
                             }
-                            mult[i].push_back(tmp);
+                            mult[i].push_back(std::move(tmp));
                         }
                     }
-                    return {mult};
+                    return {std::move(mult)};
                 }
 
                 //скалярное произведение
                 else if (l_vert == 1 && r_vert == 1) {    //строка*строка => строка*столбец
-                    Value res = Value::mul(*l, Value::transpose(*r), pos);    //если длины строк равны, mul выполнится
-                    return {res.get_matrix()[0][0]};
+                    Value res = Value::mul(std::move(left), Value::transpose(right), pos);    //если длины строк равны, mul выполнится
+                    return res.at(0, 0);
                 } else if (l_hor == 1 && r_hor == 1) {    //столбец*столбец => строка*столбец
-                    Value res = Value::mul(Value::transpose(*l), *r, pos);
-                    return {res.get_matrix()[0][0]};
+                    Value res = Value::mul(Value::transpose(left), std::move(right), pos);
+                    return res.at(0, 0);
                 }
                 throw Error(pos, "Matrix/vector dimensions mismatch");
             }
@@ -597,7 +707,7 @@ public:
         throw Error(pos, "Multiplication cannot be done");
     }
 
-    static Value div(const Value &left, const Value &right, const Coordinate& pos) {
+    static Value div(Value left, const Value &right, const Coordinate& pos) {
         if (left._type == DOUBLE || left._type == INFERRED_DOUBLE) {
             if (right._type == DOUBLE || right._type == INFERRED_DOUBLE) {
                 double q = right.get_double();
@@ -616,7 +726,7 @@ public:
                 if (q == 0.0) {
                     throw Error(pos, "Division by zero");
                 }
-                return mul(Value(1.0 / q), left, pos);
+                return mul(Value(1.0 / q), std::move(left), pos);
             }
         }
 
@@ -637,12 +747,13 @@ public:
             return {static_cast<double>(left.get_double() == right.get_double())};
         }
         if (left._type == MATRIX || left._type == INFERRED_MATRIX) {
-            Matrix *l = &left.get_matrix();
-            Matrix *r = &right.get_matrix();
-            if (l->size() == r->size() && (*l)[0].size() == (*r)[0].size()) {
-                for (size_t i = 0; i < l->size(); ++i) {
-                    for (size_t j = 0; j < (*l)[0].size(); ++j) {
-                        Value x = eq((*l)[i][j], (*r)[i][j], pos);
+            if (left.rows() == right.rows() && left.cols() == right.cols()) {
+                if (left.dense() && right.dense()) {
+                    return {left.dense()->equal(*right.dense()) ? 1.0 : 0.0, dimensionless};
+                }
+                for (size_t i = 0; i < left.rows(); ++i) {
+                    for (size_t j = 0; j < left.cols(); ++j) {
+                        Value x = eq(left.at(i, j), right.at(i, j), pos);
                         if (x.get_double() == 0.0) return {0.0, dimensionless};
                     }
                 }
@@ -710,18 +821,19 @@ public:
     }
 
     static Value transpose(const Value &matrix) {
-        Matrix *m = &matrix.get_matrix();
-        Matrix mt;
-        size_t rows = (*m)[0].size();
-        size_t cols = (*m).size();
-        mt.resize(rows);
+        size_t rows = matrix.cols();
+        size_t cols = matrix.rows();
+        if (matrix.dense()) {
+            return Value(matrix.dense()->transpose());
+        }
+        Matrix mt(rows);
         for (size_t i = 0; i < rows; ++i) {
-            mt[i].resize(cols);
+            mt[i].reserve(cols);
             for (size_t j = 0; j < cols; ++j) {
-                mt[i][j] = (*m)[j][i];
+                mt[i].push_back(matrix.at(j, i));
             }
         }
-        return {mt};
+        return {std::move(mt)};
     }
 
     // Проверка идентичности размерностей
@@ -785,12 +897,12 @@ public:
         return true;
     }
 
-    static bool is_matrix_equals_dims(const Matrix& first, const Matrix& second) {
-        if (first.size() != second.size()) {
+    static bool is_matrix_equals_dims(const Value& first, const Value& second) {
+        if (first.rows() != second.rows()) {
             return false;
         }
 
-        if (first[0].size() != second[0].size()) {
+        if (first.cols() != second.cols()) {
             return false;
         }
 
@@ -806,5 +918,5 @@ typedef struct Replacement {
 
     Replacement();
 
-    Replacement(Tag, size_t, size_t, const Value& = Value(0.0, Value::dimensionless));
+    Replacement(Tag, size_t, size_t, Value = Value(0.0, Value::dimensionless));
 } Replacement;
\ No newline at end of file
@@ -0,0 +1,408 @@
+#include "Vm.h"
+#include "Compiler.h"
+
+
+//GCC и Clang умеют переходить по адресу метки: каждая команда хранит адрес своего обработчика,
+//и обработчик сразу прыгает на следующий. Иначе - обычный switch в цикле.
+//Такой переход не вызывает деструкторы, поэтому у обработчиков нет локальных объектов с деструкторами
+#if defined(__GNUC__)
+#define VM_THREADED
+#endif
+
+#ifdef VM_THREADED
+#define OP(x) L_##x:
+#define NEXT() goto *(++ip)->handler
+#define JUMP(t) do { ip = code + (t); goto *ip->handler; } while (0)
+#else
+#define OP(x) case x:
+#define NEXT() { ++ip; continue; }
+#define JUMP(t) { ip = code + (t); continue; }
+#endif
+
+
+//слот кадра: ячейки таблиц имен, из которых имя читается, в которую пишется и которая меняется на месте.
+//Связывается при первом обращении: узлы std::map не перемещаются, а глобальные имена не удаляются.
+//Запись может создать имя в кадре функции, закрывающее окружение, поэтому после нее чтение связывается заново
+typedef struct Slot {
+    const Value *get = nullptr;
+    Value *put = nullptr;
+    Value *own = nullptr;
+} Slot;
+
+static inline bool number(const Value &v) {
+    return v._type == Value::DOUBLE || v._type == Value::INFERRED_DOUBLE;
+}
+
+//записать число в регистр без временного Value, если там не матрица и не функция
+inline void Vm::set(Value &v, double d, const std::array<int, 7> &dim) {
+    if (number(v) || v._type == Value::UNDEFINED) {
+        v._type = Value::DOUBLE;
+        v._double_data = d;
+        v._dimension = dim;
+    } else {
+        v = Value(d, dim);
+    }
+}
+
+Value Vm::run(Context &ctx, Node root, Frame *scope) {
+    std::shared_ptr<const Chunk> chunk = Compiler(*root.ast()).compile(root.id());
+    return run(ctx, *root.ast(), *chunk, scope);
+}
+
+Value Vm::run(Context &ctx, const Ast &ast, const Chunk &chunk, Frame *scope) {
+    return execute(&ctx, &ast, &chunk, scope, nullptr);
+}
+
+void Vm::thread(Chunk &chunk) {
+#ifdef VM_THREADED
+    const void *const *labels = nullptr;
+    execute(nullptr, nullptr, nullptr, nullptr, &labels);
+    for (auto &i : chunk.code) {
+        i.handler = labels[i.op];
+    }
+#endif
+}
+
+//аргументы - в новый кадр, как у Value::call; тело компилируется при первом вызове из любого потока
+Value Vm::call(Context &ctx, Value fv, Value *args, size_t argc) {
+    const Func &f = *fv.get_function();     //копия fv держит функцию, даже если тело ее переопределит
+    std::call_once(f.compiled, [&f] {
+        f.chunk = Compiler(f.code).compile(f.body.id());
+    });
+    Frame frame{{}, &f.local};
+    for (size_t i = 0; i < f.argv.size() && i < argc; ++i) {
+        frame.vars[f.argv[i]] = std::move(args[i]);
+    }
+    return execute(&ctx, &f.code, f.chunk.get(), &frame, nullptr);
+}
+
+Value Vm::execute(Context *ctx, const Ast *ast, const Chunk *chunk, Frame *scope,
+                  const void *const **labels) {
+#ifdef VM_THREADED
+    static const void *const table[] = {
+        &&L_OP_LOADK, &&L_OP_LOAD, &&L_OP_INDEX, &&L_OP_STORE, &&L_OP_STOREIDX,
+        &&L_OP_ADD, &&L_OP_SUB, &&L_OP_MUL, &&L_OP_DIV, &&L_OP_POW,
+        &&L_OP_EQ, &&L_OP_NEQ, &&L_OP_LT, &&L_OP_LEQ, &&L_OP_GT, &&L_OP_GEQ, &&L_OP_AND, &&L_OP_OR,
+        &&L_OP_USUB, &&L_OP_NOT, &&L_OP_ABS,
+        &&L_OP_JMP, &&L_OP_JZERO, &&L_OP_JNOTONE,
+        &&L_OP_CALL, &&L_OP_BUILTIN1, &&L_OP_FLOOR1, &&L_OP_BUILTIN2,
+        &&L_OP_REPL, &&L_OP_REPLDIV, &&L_OP_EVAL,
+        &&L_OP_FORINIT, &&L_OP_FORTEST, &&L_OP_FORNEXT, &&L_OP_FOREND, &&L_OP_ACCUM, &&L_OP_FINISH,
+        &&L_OP_RET
+    };
+    static_assert(sizeof(table) / sizeof(table[0]) == OP_COUNT, "handler for every opcode");
+    if (labels) {
+        *labels = table;
+        return {};
+    }
+#endif
+
+    std::vector<Value> regs(chunk->regs);
+    std::vector<Slot> slots(chunk->names.size());
+    auto get = [&](uint32_t k, node_id n) -> const Value & {
+        if (!slots[k].get) slots[k].get = &ctx->lookup(chunk->names[k], scope, ast->coord(n));
+        return *slots[k].get;
+    };
+    auto put = [&](uint32_t k) -> Value & {
+        if (!slots[k].put) {
+            slots[k].put = &ctx->target(chunk->names[k], scope);
+            slots[k].get = nullptr;
+        }
+        return *slots[k].put;
+    };
+    auto own = [&](uint32_t k, node_id n) -> Value & {
+        if (!slots[k].own) {
+            slots[k].own = &ctx->change(chunk->names[k], scope, ast->coord(n));
+            slots[k].get = slots[k].own;
+        }
+        return *slots[k].own;
+    };
+    const Value *consts = chunk->consts.data();
+    const Instr *code = chunk->code.data();
+    const Instr *ip = code;
+
+#ifdef VM_THREADED
+    goto *ip->handler;
+#else
+    for (;;) switch (ip->op) {
+#endif
+
+    OP(OP_LOADK) {
+        regs[ip->a] = consts[ip->b];
+        NEXT();
+    }
+    OP(OP_LOAD) {
+        regs[ip->a] = get(ip->b, ip->n);
+        NEXT();
+    }
+    OP(OP_INDEX) {
+        node_id n = ip->n;
+        const Value &mv = get(ip->d, n);
+        size_t ver = mv.rows();
+        size_t hor = mv.cols();
+        int int_i = (int) regs[ip->b].get_double();
+        if (int_i < 0) {
+            throw Error(ast->coord(ast->left(n)), "Negative index");
+        }
+        size_t i = int_i;
+        size_t j = 0;
+        if (ip->c == Chunk::NOREG) {    //элемент вектора
+            if (ver == 1) {
+                j = i;
+                i = 0;
+            } else if (hor != 1) {
+                throw Error(ast->coord(n), "Can't use vector index for matrix");
+            }
+        } else {
+            int int_j = (int) regs[ip->c].get_double();
+            if (int_j < 0) {
+                throw Error(ast->coord(ast->left(n)), "Negative index");
+            }
+            j = int_j;
+        }
+        if (i >= ver || j >= hor) {
+            throw Error(ast->coord(n), "Index is out of range");
+        }
+        const DenseMatrix *dm = mv.dense();
+        if (dm) set(regs[ip->a], dm->at(i, j), dm->dim);    //число плотной матрицы - прямо в регистр
+        else regs[ip->a] = mv.at(i, j);
+        NEXT();
+    }
+    OP(OP_STORE) {
+        put(ip->a) = regs[ip->b];
+        NEXT();
+    }
+    OP(OP_STOREIDX) {
+        node_id n = ip->n;
+        node_id l = ast->left(n);
+        Value &mv = own(ip->d, l);
+        size_t ver = mv.rows();
+        size_t hor = mv.cols();
+        int int_i = (int) regs[ip->b].get_double();
+        if (int_i < 0) {
+            throw Error(ast->coord(l), "Negative index");
+        }
+        size_t i = int_i;
+        size_t j = 0;
+        if (ip->c == Chunk::NOREG) {
+            if (ver == 1) {
+                j = i;
+                i = 0;
+            } else if (hor != 1) {
+                throw Error(ast->coord(n), "Bad index");
+            }
+        } else {
+            int int_j = (int) regs[ip->c].get_double();
+            if (int_j < 0) {
+                throw Error(ast->coord(l), "Negative index");
+            }
+            j = int_j;
+        }
+        if (i >= ver || j >= hor) {
+            throw Error(ast->coord(n), "Index is out of range");
+        }
+        mv.set_at(i, j, regs[ip->a]);     //общие с другими значениями элементы копируются здесь
+        NEXT();
+    }
+
+    //у чисел результат пишется прямо в регистр, остальное - через операции Value.
+    //Левый операнд лежит в регистре результата, правый - во временном (Compiler::expr),
+    //поэтому операции их забирают, а не копируют
+    OP(OP_ADD) {
+        const Value &l = regs[ip->b], &r = regs[ip->c];
+        if (number(l) && number(r)) set(regs[ip->a], l._double_data + r._double_data, l._dimension);
+        else regs[ip->a] = Value::plus(std::move(regs[ip->b]), r, ast->coord(ip->n));
+        NEXT();
+    }
+    OP(OP_SUB) {
+        const Value &l = regs[ip->b], &r = regs[ip->c];
+        if (number(l) && number(r)) set(regs[ip->a], l._double_data - r._double_data, l._dimension);
+        else regs[ip->a] = Value::sub(std::move(regs[ip->b]), r, ast->coord(ip->n));
+        NEXT();
+    }
+    OP(OP_MUL) {
+        const Value &l = regs[ip->b], &r = regs[ip->c];
+        if (number(l) && number(r)) {
+            std::array<int, 7> dim;
+            for (int k = 0; k < 7; ++k) dim[k] = l._dimension[k] + r._dimension[k];
+            set(regs[ip->a], l._double_data * r._double_data, dim);
+        } else {
+            regs[ip->a] = Value::mul(std::move(regs[ip->b]), std::move(regs[ip->c]), ast->coord(ip->n));
+        }
+        NEXT();
+    }
+    OP(OP_DIV) {
+        const Value &l = regs[ip->b], &r = regs[ip->c];
+        if (number(l) && number(r) && r._double_data != 0.0) {
+            std::array<int, 7> dim;
+            for (int k = 0; k < 7; ++k) dim[k] = l._dimension[k] - r._dimension[k];
+            set(regs[ip->a], l._double_data / r._double_data, dim);
+        } else {
+            regs[ip->a] = Value::div(std::move(regs[ip->b]), r, ast->coord(ip->n));
+        }
+        NEXT();
+    }
+    OP(OP_POW) {
+        regs[ip->a] = Value::pow(regs[ip->b], regs[ip->c], ast->coord(ip->n));
+        NEXT();
+    }
+    OP(OP_EQ) {
+        regs[ip->a] = Value::eq(regs[ip->b], regs[ip->c], ast->coord(ip->n));
+        NEXT();
+    }
+    OP(OP_NEQ) {
+        double e = Value::eq(regs[ip->b], regs[ip->c], ast->coord(ip->n)).get_double();
+        set(regs[ip->a], static_cast<double>(!e), Value::dimensionless);
+        NEXT();
+    }
+    OP(OP_LT) {
+        set(regs[ip->a], static_cast<double>(regs[ip->b].get_double() < regs[ip->c].get_double()),
+            Value::dimensionless);
+        NEXT();
+    }
+    OP(OP_LEQ) {
+        set(regs[ip->a], static_cast<double>(regs[ip->b].get_double() <= regs[ip->c].get_double()),
+            Value::dimensionless);
+        NEXT();
+    }
+    OP(OP_GT) {
+        set(regs[ip->a], static_cast<double>(regs[ip->b].get_double() > regs[ip->c].get_double()),
+            Value::dimensionless);
+        NEXT();
+    }
+    OP(OP_GEQ) {
+        set(regs[ip->a], static_cast<double>(regs[ip->b].get_double() >= regs[ip->c].get_double()),
+            Value::dimensionless);
+        NEXT();
+    }
+    OP(OP_AND) {
+        set(regs[ip->a], static_cast<double>(regs[ip->b].get_double() && regs[ip->c].get_double()),
+            Value::dimensionless);
+        NEXT();
+    }
+    OP(OP_OR) {
+        set(regs[ip->a], static_cast<double>(regs[ip->b].get_double() || regs[ip->c].get_double()),
+            Value::dimensionless);
+        NEXT();
+    }
+    OP(OP_USUB) {
+        Value &v = regs[ip->b];
+        if (number(v)) set(regs[ip->a], -v._double_data, v._dimension);
+        else regs[ip->a] = Value::usub(std::move(v), ast->coord(ip->n));
+        NEXT();
+    }
+    OP(OP_NOT) {
+        regs[ip->a] = Value::eq(regs[ip->b], Value(0.0, Value::dimensionless), ast->coord(ip->n));
+        NEXT();
+    }
+    OP(OP_ABS) {
+        regs[ip->a] = Value::abs(regs[ip->b], ast->coord(ip->n));
+        NEXT();
+    }
+
+    OP(OP_JMP) {
+        JUMP(ip->d);
+    }
+    OP(OP_JZERO) {
+        if (!regs[ip->b].get_double()) JUMP(ip->d);
+        NEXT();
+    }
+    OP(OP_JNOTONE) {
+        if (regs[ip->b].get_double() != 1.0) JUMP(ip->d);
+        NEXT();
+    }
+
+    OP(OP_CALL) {
+        regs[ip->a] = call(*ctx, get(ip->d, ip->n), &regs[ip->b], ip->c);
+        NEXT();
+    }
+    OP(OP_BUILTIN1) {
+        const Value &x = regs[ip->b];
+        if (!Value::is_dimensionless(x)) {
+            throw Error(ast->coord(ip->n), ast->label(ip->n) + " gets only dimensionless argument");
+        }
+        set(regs[ip->a], chunk->fn1[ip->c](x.get_double()), x.get_dimension());
+        NEXT();
+    }
+    OP(OP_FLOOR1) {
+        const Value &x = regs[ip->b];
+        set(regs[ip->a], chunk->fn1[ip->c](x.get_double()), x.get_dimension());
+        NEXT();
+    }
+    OP(OP_BUILTIN2) {
+        double y = chunk->fn2[ip->c](regs[ip->b].get_double(), regs[ip->b + 1].get_double());
+        set(regs[ip->a], y, Value::dimensionless);
+        NEXT();
+    }
+
+    OP(OP_REPL) {
+        ctx->reps[ast->coord(ast->right(ip->n))].replacement = std::move(regs[ip->a]);    //дальше регистр не читается
+        NEXT();
+    }
+    OP(OP_REPLDIV) {
+        ctx->reps[ast->coord(ast->right(ip->n))].replacement =
+            Value::div(std::move(regs[ip->a]), regs[ip->b], ast->coord(ip->n));
+        NEXT();
+    }
+    OP(OP_EVAL) {
+        regs[ip->a] = Node(ast, ip->n).exec(*ctx, scope);
+        if (scope) {    //обход дерева мог создать имена в кадре функции
+            for (auto &s : slots) s.get = nullptr;
+        }
+        NEXT();
+    }
+
+    //\sum и \prod: счетчик сравнивается и увеличивается в регистре, в переменную только записывается
+    OP(OP_FORINIT) {
+        double x = regs[ip->a].get_double();
+        double to = regs[ip->b].get_double();
+        set(regs[ip->a], x, Value::dimensionless);
+        set(regs[ip->b], to, Value::dimensionless);
+        Slot &var = slots[ip->c];     //ячейка счетчика может отличаться от ячейки присваивания того же имени
+        var.own = &ctx->counter(chunk->names[ip->c], scope);
+        var.get = var.own;
+        *var.own = Value(x, Value::dimensionless);
+        NEXT();
+    }
+    OP(OP_FORTEST) {
+        if (!(regs[ip->a]._double_data <= regs[ip->b]._double_data)) JUMP(ip->d);
+        set(*slots[ip->c].own, regs[ip->a]._double_data, Value::dimensionless);
+        NEXT();
+    }
+    OP(OP_FORNEXT) {
+        regs[ip->a]._double_data += 1.0;
+        JUMP(ip->d);
+    }
+    OP(OP_FOREND) {
+        set(*slots[ip->c].own, regs[ip->a]._double_data, Value::dimensionless);
+        NEXT();
+    }
+    OP(OP_ACCUM) {
+        Value &acc = regs[ip->a];
+        Value &t = regs[ip->b];     //регистр слагаемого до следующего шага не читается
+        if (acc._type == Value::UNDEFINED) {    //первое слагаемое задает размерность
+            acc = std::move(t);
+        } else if (ip->c == 0) {
+            if (number(acc) && number(t)) set(acc, acc._double_data + t._double_data, acc._dimension);
+            else acc = Value::plus(std::move(acc), t, ast->coord(ip->n));
+        } else {
+            acc = Value::mul(std::move(acc), std::move(t), ast->coord(ip->n));
+        }
+        NEXT();
+    }
+    OP(OP_FINISH) {
+        if (regs[ip->a]._type == Value::UNDEFINED) {
+            regs[ip->a] = Value(ip->c == 0 ? 0.0 : 1.0, Value::dimensionless);
+        }
+        NEXT();
+    }
+    OP(OP_RET) {
+        return std::move(regs[ip->a]);
+    }
+
+#ifndef VM_THREADED
+        default:
+            return {};
+    }
+#endif
+}
@@ -0,0 +1,25 @@
+#pragma once
+
+#include "Bytecode.h"
+#include "Context.h"
+
+
+//регистровая машина для команд Compiler; результаты совпадают с обходом дерева Node::exec.
+//Кадр выполнения - регистры и слоты переменных; сами значения имен по-прежнему в таблицах Context и Frame
+class Vm {
+public:
+    static Value run(Context &ctx, Node root, Frame *scope);   //скомпилировать и выполнить
+
+    static Value run(Context &ctx, const Ast &ast, const Chunk &chunk, Frame *scope);
+
+    static void thread(Chunk &chunk);   //записать в команды адреса обработчиков
+
+private:
+    static void set(Value &v, double d, const std::array<int, 7> &dim);
+
+    static Value call(Context &ctx, Value fv, Value *args, size_t argc);    //аргументы забираются из регистров
+
+    //labels != nullptr: вернуть таблицу адресов обработчиков, ничего не выполняя
+    static Value execute(Context *ctx, const Ast *ast, const Chunk *chunk, Frame *scope,
+                         const void *const **labels);
+};
@@ -0,0 +1,297 @@
+#include <chrono>
+#include <iostream>
+#include <set>
+#include <cerrno>
+#include <poll.h>
+#include <unistd.h>
+#include <sys/inotify.h>
+
+#include "Watch.h"
+#include "Cache.h"
+#include "Error.h"
+#include "FileHandler.h"
+#include "Lexer.h"
+
+
+Document::Document(const std::string& in, const std::string& out, bool vm) : in_(in), out_(out), vm_(vm) {}
+
+const std::string& Document::input() const {
+    return in_;
+}
+
+size_t Document::executed() const {
+    return executed_;
+}
+
+size_t Document::reused() const {
+    return reused_;
+}
+
+bool Document::update(std::ostream& log) {
+    executed_ = 0;
+    reused_ = 0;
+
+    //блоки прошлого обновления: одинаковый блок на прежнем месте берется целиком,
+    //из остальных берутся результаты операторов с тем же текстом
+    std::vector<std::unique_ptr<Block>> old;
+    old.swap(blocks_);
+    std::multimap<std::string_view, size_t> old_blocks;
+    for (size_t i = 0; i < old.size(); ++i) {
+        old_blocks.emplace(old[i]->text, i);
+    }
+    std::multimap<std::string, Statement*> pool;    //собирается, только когда встретился измененный блок
+    bool pooled = false;
+
+    std::string tmp = out_ + ".tmp";    //выходной файл заменяется целиком только после успешной обработки
+    Context ctx;
+    ctx.vm = vm_;
+    FileHandler fh(in_.c_str(), tmp.c_str());
+    if (!fh.good()) {
+        log << in_ << ":" << "Failed to initialize" << std::endl;
+        return false;
+    }
+
+    bool ok = true;
+    try {
+        while (true) {
+            ProgramString ps = fh.next();
+            if (ps.program.empty()) {
+                break;
+            }
+            std::unique_ptr<Block> b;
+            auto range = old_blocks.equal_range(ps.program);
+            for (auto it = range.first; it != range.second; ++it) {
+                if (old[it->second]->ps.begin == ps.begin) {
+                    b = std::move(old[it->second]);
+                    old_blocks.erase(it);
+                    break;
+                }
+            }
+            if (b && pooled) {
+                for (auto& st : b->stmts) {     //результаты остаются у своего оператора
+                    auto r = pool.equal_range(st->text);
+                    for (auto it = r.first; it != r.second; ++it) {
+                        if (it->second == st.get()) {
+                            pool.erase(it);
+                            break;
+                        }
+                    }
+                }
+            }
+            if (!b) {
+                if (!pooled) {
+                    for (auto& ob : old) {
+                        if (!ob) continue;
+                        for (auto& st : ob->stmts) pool.emplace(st->text, st.get());
+                    }
+                    pooled = true;
+                }
+                b = parse(ps, pool);
+            }
+            blocks_.push_back(std::move(b));
+            run(ctx, *blocks_.back(), fh.out());
+        }
+    }
+    catch (Error& err) {
+        log << in_ << ":" << err.what() << std::endl;
+        ok = false;
+    }
+    catch (Value::BadType& err) {
+        log << in_ << ":" << err.what() << std::endl;
+        ok = false;
+    }
+    catch (std::exception& err) {
+        log << in_ << ":" << err.what() << std::endl;
+        ok = false;
+    }
+
+    if (!ok) {
+        fh.remove_out();
+        //ошибка обычно в одном месте, результаты необработанных блоков пригодятся в следующий раз
+        for (auto& b : old) {
+            if (b) blocks_.push_back(std::move(b));
+        }
+        return false;
+    }
+    return !fh.rename_out(out_.c_str());
+}
+
+std::unique_ptr<Block> Document::parse(const ProgramString& ps, std::multimap<std::string, Statement*>& pool) {
+    std::unique_ptr<Block> b(new Block());
+    b->text = std::string(ps.program);
+    b->ps = ps;
+    b->ps.program = b->text;
+
+    Lexer l;
+    Tokens tokens;
+    l.open(b->ps, tokens);
+
+    //то же, что Parser::block, но у каждого оператора свое дерево и свои места замен
+    Parser p;
+    replacement_map none;
+    p.init(l, tokens, none, b->ast);
+    while (p.cur()->_tag != NONE) {
+        if (p.cur()->_tag == BREAK) {
+            p.get();
+            continue;
+        }
+        std::unique_ptr<Statement> st(new Statement());
+        p.reps = &st->reps;
+        size_t begin = p.cur()->start;
+        st->node = Node(&b->ast, p.expression(0));
+        size_t end = std::max(begin, size_t(l.at(p.i - 1)->end));  //последний прочитанный токен еще в буфере лексера
+        st->text = b->text.substr(begin, end - begin);
+
+        auto it = pool.find(st->text);
+        if (it != pool.end()) {
+            Statement *prev = it->second;
+            pool.erase(it);
+            if (prev->done && prev->reps.size() == st->reps.size()) {
+                st->done = true;
+                st->rec = std::move(prev->rec);
+                st->outputs = std::move(prev->outputs);
+                st->origins = std::move(prev->origins);
+                auto r = prev->reps.begin();    //тот же текст - те же замены в том же порядке
+                for (auto& rep : st->reps) {
+                    rep.second.replacement = (r++)->second.replacement;
+                }
+                prev->done = false;
+            }
+        }
+        b->stmts.push_back(std::move(st));
+    }
+    return b;
+}
+
+bool Document::fresh(Context& ctx, const Statement& st) {
+    if (!st.done || st.rec.opaque) return false;
+    for (auto& r : st.rec.reads) {
+        auto it = ctx.global.find(r.first);
+        if (it == ctx.global.end() || ctx.value_hash(r.first, it->second) != r.second) return false;
+    }
+    return true;
+}
+
+void Document::run(Context& ctx, Block& b, OutputBuffer& out) {
+    //анализ дешевый и зависит только от предыдущих блоков, поэтому выполняется всегда
+    for (auto& st : b.stmts) {
+        st->node.semantic_analysis(ctx);
+    }
+
+    for (auto& st : b.stmts) {
+        if (fresh(ctx, *st)) {
+            for (auto& it : st->outputs) ctx.global[it.first] = it.second;
+            for (auto& it : st->origins) ctx.origins[it.first] = it.second;
+            ++reused_;
+            continue;
+        }
+
+        st->done = false;
+        st->rec = Record();
+        std::swap(ctx.reps, st->reps);
+        ctx.record(&st->rec);
+        try {
+            ctx.eval(st->node);
+        }
+        catch (...) {
+            ctx.record(nullptr);
+            std::swap(ctx.reps, st->reps);
+            throw;
+        }
+        ctx.record(nullptr);
+        std::swap(ctx.reps, st->reps);
+
+        st->outputs.clear();
+        st->origins.clear();
+        for (auto& name : st->rec.defs) {
+            auto it = ctx.global.find(name);
+            if (it != ctx.global.end()) st->outputs[name] = it->second;
+        }
+        if (ctx.set_origins(Cache::hash(st->text), st->rec)) {
+            for (auto& it : st->outputs) {
+                if (it.second._type == Value::FUNCTION) st->origins[it.first] = ctx.origins[it.first];
+            }
+        }
+        st->done = true;
+        ++executed_;
+    }
+
+    replacement_map reps;
+    for (auto& st : b.stmts) {
+        reps.insert(st->reps.begin(), st->reps.end());
+    }
+    make_replacement(b.ps.program, reps, out);
+}
+
+static void report(Document& doc) {
+    auto start = std::chrono::steady_clock::now();
+    bool ok = doc.update(std::cerr);
+    auto diff = std::chrono::steady_clock::now() - start;
+    std::cout << doc.input() << ": " << (ok ? "updated, " : "FAILED, ")
+              << doc.executed() << " statements executed, " << doc.reused() << " reused, "
+              << std::chrono::duration <double, std::milli> (diff).count() << " ms" << std::endl;
+}
+
+int watch(const std::vector<std::pair<std::string, std::string>>& files, bool vm) {
+    int fd = inotify_init1(IN_CLOEXEC);
+    if (fd < 0) {
+        std::cerr << "Couldn't initialize inotify" << std::endl;
+        return 1;
+    }
+
+    //редакторы часто сохраняют через временный файл и переименование, поэтому наблюдается директория
+    typedef struct Watched {
+        int wd;
+        std::string name;
+        std::unique_ptr<Document> doc;
+    } Watched;
+    std::vector<Watched> docs;
+    for (auto& f : files) {
+        size_t slash = f.first.rfind('/');
+        std::string dir = (slash == std::string::npos) ? "." : f.first.substr(0, slash + 1);
+        int wd = inotify_add_watch(fd, dir.c_str(), IN_CLOSE_WRITE | IN_MOVED_TO);
+        if (wd < 0) {
+            std::cerr << "Couldn't watch directory: " << dir << std::endl;
+            ::close(fd);
+            return 1;
+        }
+        std::string name = (slash == std::string::npos) ? f.first : f.first.substr(slash + 1);
+        docs.push_back({wd, name, std::unique_ptr<Document>(new Document(f.first, f.second, vm))});
+        report(*docs.back().doc);
+    }
+
+    alignas(struct inotify_event) char buf[4096];
+    while (true) {
+        std::set<Document*> changed;
+        int timeout = -1;   //первого события ждать сколько угодно, затем собрать сохранения, пришедшие следом
+        while (true) {
+            struct pollfd p = {fd, POLLIN, 0};
+            int n = poll(&p, 1, timeout);
+            if (n < 0 && errno == EINTR) continue;
+            if (n < 0) {
+                std::cerr << "Couldn't read inotify events" << std::endl;
+                ::close(fd);
+                return 1;
+            }
+            if (n == 0) break;
+            ssize_t len = read(fd, buf, sizeof(buf));
+            if (len < 0) {
+                if (errno == EINTR || errno == EAGAIN) continue;
+                std::cerr << "Couldn't read inotify events" << std::endl;
+                ::close(fd);
+                return 1;
+            }
+            for (char *ptr = buf; ptr < buf + len; ) {
+                auto *ev = reinterpret_cast<struct inotify_event *>(ptr);
+                for (auto& w : docs) {
+                    if (ev->len && w.wd == ev->wd && w.name == ev->name) changed.insert(w.doc.get());
+                }
+                ptr += sizeof(struct inotify_event) + ev->len;
+            }
+            timeout = 20;
+        }
+        for (auto& w : docs) {  //в порядке командной строки
+            if (changed.count(w.doc.get())) report(*w.doc);
+        }
+    }
+}
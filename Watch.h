@@ -0,0 +1,66 @@
+#pragma once
+
+#include <map>
+#include <memory>
+#include <ostream>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "Coordinate.h"
+#include "Node.h"
+#include "Value.h"
+#include "Context.h"
+
+
+//оператор верхнего уровня блока и результаты его последнего выполнения
+typedef struct Statement {
+    std::string text;                       //исходный текст, по нему результаты находятся после правки файла
+    Node node;                              //в дереве блока
+    replacement_map reps;                   //места замен этого оператора
+    bool done = false;                      //результаты ниже получены выполнением и действительны
+    Record rec;                             //что оператор прочитал и определил
+    name_table outputs;                     //значения определенных имен после выполнения
+    std::map<std::string, uint64_t> origins;    //происхождение определенных функций
+} Statement;
+
+typedef struct Block {
+    std::string text;                       //копия текста, файл между обновлениями перечитывается
+    ProgramString ps;                       //view на text
+    Ast ast;                                //деревья операторов
+    std::vector<std::unique_ptr<Statement>> stmts;
+} Block;
+
+//документ, который держится в памяти между изменениями входного файла:
+//деревья неизмененных блоков переиспользуются, а оператор выполняется заново,
+//только если изменился его текст или значение одного из прочитанных им глобальных имен
+class Document {
+public:
+    Document(const std::string& in, const std::string& out, bool vm = false);
+
+    bool update(std::ostream& log);     //обработать текущее содержимое входного файла
+
+    const std::string& input() const;
+
+    size_t executed() const;    //операторов выполнено при последнем обновлении
+
+    size_t reused() const;      //операторов взято из предыдущего обновления
+
+private:
+    std::string in_;
+    std::string out_;
+    std::vector<std::unique_ptr<Block>> blocks_;
+    size_t executed_ = 0;
+    size_t reused_ = 0;
+    bool vm_;
+
+    std::unique_ptr<Block> parse(const ProgramString& ps, std::multimap<std::string, Statement*>& pool);
+
+    void run(Context& ctx, Block& b, OutputBuffer& out);
+
+    bool fresh(Context& ctx, const Statement& st);
+};
+
+//наблюдать за входными файлами (пары вход - выход) через inotify и обновлять выходные после каждого сохранения;
+//возвращается только при ошибке
+int watch(const std::vector<std::pair<std::string, std::string>>& files, bool vm = false);
@@ -5,6 +5,12 @@
 #include "set"
 
 #include "basic_HM.h"
+#include "Context.h"
+
+
+std::string& Type::toString() {
+    return label;
+}
 
 
 TypeVariable::TypeVariable() = default;
@@ -28,7 +34,7 @@ bool is_number(const std::string& name) {
 }
 
 
-Node* get_base_type(Node* object) {
+Type* get_base_type(Type* object) {
     auto* type_var = dynamic_cast<TypeVariable*>(object);
 
     if (type_var != nullptr) {
@@ -43,7 +49,7 @@ Node* get_base_type(Node* object) {
 
 
 bool any_type_match(
-    Node* target,
+    Type* target,
     const std::vector<TypeVariable*>& source
 ) {
     for (auto& type : source) {
@@ -58,10 +64,10 @@ bool any_type_match(
 
 
 bool type_match(
-    Node* target,
-    Node* source
+    Type* target,
+    Type* source
 ) {
-    Node* source_base_type = get_base_type(source);
+    Type* source_base_type = get_base_type(source);
 
     if (source_base_type == target) {
         return true;
@@ -76,7 +82,7 @@ bool type_match(
 
 
 bool is_generic_type(
-    Node* target,
+    Type* target,
     const std::vector<TypeVariable *> &source
 ) {
     return !any_type_match(target, source);
@@ -84,11 +90,11 @@ bool is_generic_type(
 
 
 void unification(
-    Node* type1,
-    Node* type2
+    Type* type1,
+    Type* type2
 ) {
-    Node* base_type_1 = get_base_type(type1);
-    Node* base_type_2 = get_base_type(type2);
+    Type* base_type_1 = get_base_type(type1);
+    Type* base_type_2 = get_base_type(type2);
 
     auto* type_var1 = dynamic_cast<TypeVariable*>(base_type_1);
     auto* type_var2 = dynamic_cast<TypeVariable*>(base_type_1);
@@ -128,12 +134,12 @@ void unification(
 }
 
 
-Node* copy_type_rec(
-    Node* type,
+Type* copy_type_rec(
+    Type* type,
     const std::vector<TypeVariable *> &non_generic,
     std::map<TypeVariable*, TypeVariable*> mapping
 ) {
-    Node* base_type = get_base_type(type);
+    Type* base_type = get_base_type(type);
 
     auto* type_var = dynamic_cast<TypeVariable*>(base_type);
     auto* type_op = dynamic_cast<TypeOperator*>(base_type);
@@ -154,7 +160,7 @@ Node* copy_type_rec(
             std::vector<TypeVariable*> new_types;
 
             for (auto& cur_type : type_op->types) {
-                Node* copied_obj = copy_type_rec(cur_type, non_generic, mapping);
+                Type* copied_obj = copy_type_rec(cur_type, non_generic, mapping);
                 auto* copied_type = dynamic_cast<TypeVariable*>(copied_obj);
 
                 if (copied_type != nullptr) {
@@ -172,8 +178,8 @@ Node* copy_type_rec(
 }
 
 
-Node* copy_type(
-    Node* type,
+Type* copy_type(
+    Type* type,
     const std::vector<TypeVariable *> &non_generic
 ) {
     std::map<TypeVariable*, TypeVariable*> mapping;
@@ -182,20 +188,18 @@ Node* copy_type(
 }
 
 
-auto global_idents = name_table();
-auto global_funcs = name_table();
-auto global_funcs_body = std::map<std::string, std::pair<Node*, std::vector<std::pair<std::string, Value>>>>();
-
 std::pair<Value, std::vector<std::pair<std::string, Value>>> analyse(
-    Node *node,
+    Context &ctx,
+    Node node,
     bool inside_func_or_block,
     std::vector<std::pair<std::string, Value>> local_vars,
     bool is_usub
 ) {
-    Tag& current_tag = node->get_tag();
+    Tag current_tag = node.get_tag();
 
     if (current_tag == Tag::NUMBER) {
-        double val = std::stod(node->get_label());
+        double val = node.number();
+        if (std::isnan(val)) val = std::stod(node.get_label());
 
         if (is_usub) {
             val = -val;
@@ -205,7 +209,7 @@ std::pair<Value, std::vector<std::pair<std::string, Value>>> analyse(
     }
 
     if (current_tag == Tag::IDENT) {
-        const auto& ident_name = node->get_label();
+        const auto& ident_name = node.get_label();
 
         bool founded = false;
         Value val;
@@ -217,33 +221,34 @@ std::pair<Value, std::vector<std::pair<std::string, Value>>> analyse(
             }
         }
 
-        if (global_idents.count(ident_name) > 0) {
-            return {global_idents[ident_name], local_vars};
+        if (ctx.idents.count(ident_name) > 0) {
+            return {ctx.idents[ident_name], local_vars};
         } else if (inside_func_or_block && founded) {
             return {val, local_vars};
         } else {
-            throw std::invalid_argument("IDENT does not exists; node: " + node->toString());
+            throw std::invalid_argument("IDENT does not exists; node: " + node.toString());
         }
     }
 
     if (current_tag == Tag::FUNC) {
-        if (global_funcs.count(node->get_label()) > 0) {
-            const auto& func_args = global_funcs_body.find(node->get_label())->second.second;
+        if (ctx.funcs.count(node.get_label()) > 0) {
+            const auto& func_args = ctx.funcs_body.find(node.get_label())->second.second;
 
-            if (node->fields.size() != func_args.size()) {
+            if (node.fields().size() != func_args.size()) {
                 throw std::invalid_argument(
                         "FUNC has an incorrect amount of args: " +
-                        std::to_string(node->fields.size()) +
+                        std::to_string(node.fields().size()) +
                         " instead of: " +
                         std::to_string(func_args.size()) +
                         " in node: " +
-                        node->toString()
+                        node.toString()
                 );
             }
 
-            for (int i = 0; i < node->fields.size(); i++) {
+            for (int i = 0; i < node.fields().size(); i++) {
                 const auto& calculated = analyse(
-                    node->fields[i],
+                    ctx,
+                    node.fields()[i],
                     inside_func_or_block,
                     local_vars,
                     is_usub
@@ -273,36 +278,38 @@ std::pair<Value, std::vector<std::pair<std::string, Value>>> analyse(
                             " instead of: " +
                             Value::type_string(expected._type) +
                             " in node: " +
-                            node->toString()
+                            node.toString()
                     );
                 }
             }
 
-            return {global_funcs.find(node->get_label())->second, local_vars};
+            return {ctx.funcs.find(node.get_label())->second, local_vars};
         } else {
             for (const auto& local_var : local_vars) {
-                if (local_var.first == node->get_label()) {
+                if (local_var.first == node.get_label()) {
                     return {local_var.second, local_vars};
                 }
             }
         }
 
-        throw std::invalid_argument("FUNC does not exists; node: " + node->toString());
+        throw std::invalid_argument("FUNC does not exists; node: " + node.toString());
     }
 
     if (current_tag == Tag::BEGINC) {
-        for (auto option : node->fields) {
-            if (option->cond != nullptr) {
-                Tag cond_tag = option->cond->get_tag();
+        for (auto option : node.fields()) {
+            if (option.cond()) {
+                Tag cond_tag = option.cond().get_tag();
 
                 auto left = analyse(
-                    option->cond->left,
+                    ctx,
+                    option.cond().left(),
                     inside_func_or_block,
                     local_vars,
                     is_usub
                 );
                 auto right = analyse(
-                    option->cond->right,
+                    ctx,
+                    option.cond().right(),
                     inside_func_or_block,
                     left.second,
                     is_usub
@@ -310,17 +317,17 @@ std::pair<Value, std::vector<std::pair<std::string, Value>>> analyse(
 
                 if (
                     left.first._type == Value::UNDEFINED &&
-                    option->cond->left->get_tag() == Tag::IDENT &&
+                    option.cond().left().get_tag() == Tag::IDENT &&
                     (right.first._type == Value::DOUBLE || right.first._type == Value::INFERRED_DOUBLE)
                 ) {
                     left.first._type = Value::INFERRED_DOUBLE;
                     left.first._dimension = right.first.get_dimension();
 
-                    const std::string& ident_name = option->cond->left->get_label();
+                    const std::string& ident_name = option.cond().left().get_label();
 
-                    if (global_idents.count(ident_name) > 0) {
-                        global_idents[ident_name] = Value(0.0, right.first.get_dimension());
-                        global_idents[ident_name]._type = Value::INFERRED_DOUBLE;
+                    if (ctx.idents.count(ident_name) > 0) {
+                        ctx.idents[ident_name] = Value(0.0, right.first.get_dimension());
+                        ctx.idents[ident_name]._type = Value::INFERRED_DOUBLE;
                     } else {
                         if (inside_func_or_block) {
                             for (auto& local_var : local_vars) {
@@ -335,17 +342,17 @@ std::pair<Value, std::vector<std::pair<std::string, Value>>> analyse(
 
                 if (
                     right.first._type == Value::UNDEFINED &&
-                    option->cond->right->get_tag() == Tag::IDENT &&
+                    option.cond().right().get_tag() == Tag::IDENT &&
                     (left.first._type == Value::DOUBLE || left.first._type == Value::INFERRED_DOUBLE)
                 ) {
                     right.first._type = Value::INFERRED_DOUBLE;
                     right.first._dimension = left.first.get_dimension();
 
-                    const std::string& ident_name = option->cond->right->get_label();
+                    const std::string& ident_name = option.cond().right().get_label();
 
-                    if (global_idents.count(ident_name) > 0) {
-                        global_idents[ident_name] = Value(0.0, left.first.get_dimension());
-                        global_idents[ident_name]._type = Value::INFERRED_DOUBLE;
+                    if (ctx.idents.count(ident_name) > 0) {
+                        ctx.idents[ident_name] = Value(0.0, left.first.get_dimension());
+                        ctx.idents[ident_name]._type = Value::INFERRED_DOUBLE;
                     } else {
                         if (inside_func_or_block) {
                             for (auto& local_var : local_vars) {
@@ -368,7 +375,7 @@ std::pair<Value, std::vector<std::pair<std::string, Value>>> analyse(
                                 "Undefined value: " +
                                 to_string(left.first) +
                                 " in node: " +
-                                option->toString()
+                                option.toString()
                         );
                     }
 
@@ -377,7 +384,7 @@ std::pair<Value, std::vector<std::pair<std::string, Value>>> analyse(
                                 "Undefined value: " +
                                 to_string(right.first) +
                                 " in node: " +
-                                option->toString()
+                                option.toString()
                         );
                     }
 
@@ -386,7 +393,7 @@ std::pair<Value, std::vector<std::pair<std::string, Value>>> analyse(
                                 "Cannot compare using inferred double value: " +
                                 to_string(left.first) +
                                 " in node: " +
-                                option->toString()
+                                option.toString()
                         );
                     }
 
@@ -395,7 +402,7 @@ std::pair<Value, std::vector<std::pair<std::string, Value>>> analyse(
                                 "Cannot compare using inferred double value: " +
                                 to_string(right.first) +
                                 " in node: " +
-                                option->toString()
+                                option.toString()
                         );
                     }
 
@@ -405,44 +412,44 @@ std::pair<Value, std::vector<std::pair<std::string, Value>>> analyse(
                             " and value: " +
                             to_string(right.first) +
                             " in node: " +
-                            option->toString()
+                            option.toString()
                     );
                 }
 
                 switch (cond_tag) {
                     case Tag::GT:
                         if (left.first.get_double() > right.first.get_double()) {
-                            return analyse(option->right, inside_func_or_block, right.second, is_usub);
+                            return analyse(ctx, option.right(), inside_func_or_block, right.second, is_usub);
                         } else {
                             continue;
                         }
                     case Tag::GEQ:
                         if (left.first.get_double() >= right.first.get_double()) {
-                            return analyse(option->right, inside_func_or_block, right.second, is_usub);
+                            return analyse(ctx, option.right(), inside_func_or_block, right.second, is_usub);
                         } else {
                             continue;
                         }
                     case Tag::LT:
                         if (left.first.get_double() < right.first.get_double()) {
-                            return analyse(option->right, inside_func_or_block, right.second, is_usub);
+                            return analyse(ctx, option.right(), inside_func_or_block, right.second, is_usub);
                         } else {
                             continue;
                         }
                     case Tag::LEQ:
                         if (left.first.get_double() <= right.first.get_double()) {
-                            return analyse(option->right, inside_func_or_block, right.second, is_usub);
+                            return analyse(ctx, option.right(), inside_func_or_block, right.second, is_usub);
                         } else {
                             continue;
                         }
                     case Tag::EQ:
                         if (left.first.get_double() == right.first.get_double()) {
-                            return analyse(option->right, inside_func_or_block, right.second, is_usub);
+                            return analyse(ctx, option.right(), inside_func_or_block, right.second, is_usub);
                         } else {
                             continue;
                         }
                     case Tag::NEQ:
                         if (left.first.get_double() != right.first.get_double()) {
-                            return analyse(option->right, inside_func_or_block, right.second, is_usub);
+                            return analyse(ctx, option.right(), inside_func_or_block, right.second, is_usub);
                         } else {
                             continue;
                         }
@@ -455,21 +462,21 @@ std::pair<Value, std::vector<std::pair<std::string, Value>>> analyse(
                                 " and value: " +
                                 to_string(right.first) +
                                 " in node: " +
-                                option->toString()
+                                option.toString()
                         );
                 }
             } else {
-                return analyse(option->right, inside_func_or_block, local_vars, is_usub);
+                return analyse(ctx, option.right(), inside_func_or_block, local_vars, is_usub);
             }
         }
     }
 
     if (current_tag == Tag::UADD || current_tag == Tag::NOT || current_tag == Tag::LPAREN) {
-        return analyse(node->right, inside_func_or_block, local_vars, is_usub);
+        return analyse(ctx, node.right(), inside_func_or_block, local_vars, is_usub);
     }
 
     if (current_tag == Tag::USUB) {
-        return analyse(node->right, inside_func_or_block, local_vars, true);
+        return analyse(ctx, node.right(), inside_func_or_block, local_vars, true);
     }
 
     if (
@@ -481,24 +488,24 @@ std::pair<Value, std::vector<std::pair<std::string, Value>>> analyse(
         current_tag == Tag::LEQ ||
         current_tag == Tag::GT ||
         current_tag == Tag::GEQ ||
-        (current_tag == Tag::EQ && node->right->get_tag() != Tag::PLACEHOLDER) ||
+        (current_tag == Tag::EQ && node.right().get_tag() != Tag::PLACEHOLDER) ||
         current_tag == Tag::NEQ
     ) {
-        auto left = analyse(node->left, inside_func_or_block, local_vars, is_usub);
-        auto right = analyse(node->right, inside_func_or_block, left.second, is_usub);
+        auto left = analyse(ctx, node.left(), inside_func_or_block, local_vars, is_usub);
+        auto right = analyse(ctx, node.right(), inside_func_or_block, left.second, is_usub);
 
         if (
             left.first._type == Value::UNDEFINED &&
-            node->left->get_tag() == Tag::IDENT &&
+            node.left().get_tag() == Tag::IDENT &&
             (right.first._type == Value::DOUBLE || right.first._type == Value::INFERRED_DOUBLE)
         ) {
             left.first._type = Value::INFERRED_DOUBLE;
             left.first._dimension = right.first.get_dimension();
-            const std::string& ident_name = node->left->get_label();
+            const std::string& ident_name = node.left().get_label();
 
-            if (global_idents.count(ident_name) > 0) {
-                global_idents[ident_name] = Value(0.0, right.first.get_dimension());
-                global_idents[ident_name]._type = Value::INFERRED_DOUBLE;
+            if (ctx.idents.count(ident_name) > 0) {
+                ctx.idents[ident_name] = Value(0.0, right.first.get_dimension());
+                ctx.idents[ident_name]._type = Value::INFERRED_DOUBLE;
             } else {
                 if (inside_func_or_block) {
                     for (int i = 0; i < local_vars.size(); i++) {
@@ -513,20 +520,20 @@ std::pair<Value, std::vector<std::pair<std::string, Value>>> analyse(
 
         if (
             left.first._type == Value::UNDEFINED &&
-            node->left->get_tag() == Tag::IDENT &&
+            node.left().get_tag() == Tag::IDENT &&
             (right.first._type == Value::MATRIX || right.first._type == Value::INFERRED_MATRIX)
         ) {
             left.first._type = Value::INFERRED_MATRIX;
             left.first._dimension = right.first.get_dimension();
-            const std::string& ident_name = node->left->get_label();
+            const std::string& ident_name = node.left().get_label();
 
-            if (global_idents.count(ident_name) > 0) {
-                global_idents[ident_name] = Value(right.first.get_matrix());
+            if (ctx.idents.count(ident_name) > 0) {
+                ctx.idents[ident_name] = right.first.as_matrix();
             } else {
                 if (inside_func_or_block) {
                     for (int i = 0; i < local_vars.size(); i++) {
                         if (local_vars[i].first == ident_name) {
-                            local_vars[i].second = Value(right.first.get_matrix());
+                            local_vars[i].second = right.first.as_matrix();
                         }
                     }
                 }
@@ -535,16 +542,16 @@ std::pair<Value, std::vector<std::pair<std::string, Value>>> analyse(
 
         if (
             right.first._type == Value::UNDEFINED &&
-            node->right->get_tag() == Tag::IDENT &&
+            node.right().get_tag() == Tag::IDENT &&
             (left.first._type == Value::DOUBLE || left.first._type == Value::INFERRED_DOUBLE)
         ) {
             right.first._type = Value::INFERRED_DOUBLE;
             right.first._dimension = left.first.get_dimension();
-            const std::string& ident_name = node->right->get_label();
+            const std::string& ident_name = node.right().get_label();
 
-            if (global_idents.count(ident_name) > 0) {
-                global_idents[ident_name] = Value(0.0, left.first.get_dimension());
-                global_idents[ident_name]._type = Value::INFERRED_DOUBLE;
+            if (ctx.idents.count(ident_name) > 0) {
+                ctx.idents[ident_name] = Value(0.0, left.first.get_dimension());
+                ctx.idents[ident_name]._type = Value::INFERRED_DOUBLE;
             } else {
                 if (inside_func_or_block) {
                     for (int i = 0; i < local_vars.size(); i++) {
@@ -559,20 +566,20 @@ std::pair<Value, std::vector<std::pair<std::string, Value>>> analyse(
 
         if (
             right.first._type == Value::UNDEFINED &&
-            node->left->get_tag() == Tag::IDENT &&
+            node.left().get_tag() == Tag::IDENT &&
             (left.first._type == Value::MATRIX || left.first._type == Value::INFERRED_MATRIX)
         ) {
             right.first._type = Value::INFERRED_MATRIX;
             right.first._dimension = left.first.get_dimension();
-            const std::string& ident_name = node->left->get_label();
+            const std::string& ident_name = node.left().get_label();
 
-            if (global_idents.count(ident_name) > 0) {
-                global_idents[ident_name] = Value(left.first.get_matrix());
+            if (ctx.idents.count(ident_name) > 0) {
+                ctx.idents[ident_name] = left.first.as_matrix();
             } else {
                 if (inside_func_or_block) {
                     for (int i = 0; i < local_vars.size(); i++) {
                         if (local_vars[i].first == ident_name) {
-                            local_vars[i].second = Value(left.first.get_matrix());
+                            local_vars[i].second = left.first.as_matrix();
                         }
                     }
                 }
@@ -586,7 +593,7 @@ std::pair<Value, std::vector<std::pair<std::string, Value>>> analyse(
             ||
             (left.first._type == Value::MATRIX || left.first._type == Value::INFERRED_MATRIX) &&
             (right.first._type == Value::MATRIX || right.first._type == Value::INFERRED_MATRIX) &&
-            Value::is_matrix_equals_dims(left.first.get_matrix(), right.first.get_matrix()) &&
+            Value::is_matrix_equals_dims(left.first, right.first) &&
             (current_tag == Tag::ADD || current_tag == Tag::SUB)
         )) {
             if (left.first._type == Value::UNDEFINED) {
@@ -594,7 +601,7 @@ std::pair<Value, std::vector<std::pair<std::string, Value>>> analyse(
                         "Undefined value: " +
                         to_string(left.first) +
                         " in node: " +
-                        node->toString()
+                        node.toString()
                 );
             }
 
@@ -603,7 +610,7 @@ std::pair<Value, std::vector<std::pair<std::string, Value>>> analyse(
                         "Undefined value: " +
                         to_string(right.first) +
                         " in node: " +
-                        node->toString()
+                        node.toString()
                 );
             }
 
@@ -613,7 +620,7 @@ std::pair<Value, std::vector<std::pair<std::string, Value>>> analyse(
                     " and value: " +
                     to_string(right.first) +
                     " in node: " +
-                    node->toString()
+                    node.toString()
             );
         }
 
@@ -621,20 +628,20 @@ std::pair<Value, std::vector<std::pair<std::string, Value>>> analyse(
     }
 
     if (current_tag == Tag::MUL || current_tag == Tag::DIV || current_tag == Tag::FRAC) {
-        auto left = analyse(node->left, inside_func_or_block, local_vars, is_usub);
-        auto right = analyse(node->right, inside_func_or_block, left.second, is_usub);
+        auto left = analyse(ctx, node.left(), inside_func_or_block, local_vars, is_usub);
+        auto right = analyse(ctx, node.right(), inside_func_or_block, left.second, is_usub);
 
         if (
             left.first._type == Value::UNDEFINED &&
-            node->left->get_tag() == Tag::IDENT &&
+            node.left().get_tag() == Tag::IDENT &&
             (right.first._type == Value::DOUBLE || right.first._type == Value::INFERRED_DOUBLE)
         ) {
             left.first._type = Value::INFERRED_DOUBLE;
-            const std::string& ident_name = node->left->get_label();
+            const std::string& ident_name = node.left().get_label();
 
-            if (global_idents.count(ident_name) > 0) {
-                global_idents[ident_name] = Value(0.0);
-                global_idents[ident_name]._type = Value::INFERRED_DOUBLE;
+            if (ctx.idents.count(ident_name) > 0) {
+                ctx.idents[ident_name] = Value(0.0);
+                ctx.idents[ident_name]._type = Value::INFERRED_DOUBLE;
             } else {
                 if (inside_func_or_block) {
                     for (auto& local_var : local_vars) {
@@ -649,20 +656,20 @@ std::pair<Value, std::vector<std::pair<std::string, Value>>> analyse(
 
         if (
             left.first._type == Value::UNDEFINED &&
-            node->left->get_tag() == Tag::IDENT &&
+            node.left().get_tag() == Tag::IDENT &&
             (right.first._type == Value::MATRIX || right.first._type == Value::INFERRED_MATRIX)
         ) {
             left.first._type = Value::INFERRED_MATRIX;
             left.first._dimension = right.first.get_dimension();
-            const std::string& ident_name = node->left->get_label();
+            const std::string& ident_name = node.left().get_label();
 
-            if (global_idents.count(ident_name) > 0) {
-                global_idents[ident_name] = Value(right.first.get_matrix());
+            if (ctx.idents.count(ident_name) > 0) {
+                ctx.idents[ident_name] = right.first.as_matrix();
             } else {
                 if (inside_func_or_block) {
                     for (int i = 0; i < local_vars.size(); i++) {
                         if (local_vars[i].first == ident_name) {
-                            local_vars[i].second = Value(right.first.get_matrix());
+                            local_vars[i].second = right.first.as_matrix();
                         }
                     }
                 }
@@ -671,15 +678,15 @@ std::pair<Value, std::vector<std::pair<std::string, Value>>> analyse(
 
         if (
             right.first._type == Value::UNDEFINED &&
-            node->right->get_tag() == Tag::IDENT &&
+            node.right().get_tag() == Tag::IDENT &&
             (left.first._type == Value::DOUBLE || left.first._type == Value::INFERRED_DOUBLE)
         ) {
             right.first._type = Value::INFERRED_DOUBLE;
-            const std::string& ident_name = node->right->get_label();
+            const std::string& ident_name = node.right().get_label();
 
-            if (global_idents.count(ident_name) > 0) {
-                global_idents[ident_name] = Value(0.0);
-                global_idents[ident_name]._type = Value::INFERRED_DOUBLE;
+            if (ctx.idents.count(ident_name) > 0) {
+                ctx.idents[ident_name] = Value(0.0);
+                ctx.idents[ident_name]._type = Value::INFERRED_DOUBLE;
             } else {
                 if (inside_func_or_block) {
                     for (auto& local_var : local_vars) {
@@ -694,20 +701,20 @@ std::pair<Value, std::vector<std::pair<std::string, Value>>> analyse(
 
         if (
             right.first._type == Value::UNDEFINED &&
-            node->left->get_tag() == Tag::IDENT &&
+            node.left().get_tag() == Tag::IDENT &&
             (left.first._type == Value::MATRIX || left.first._type == Value::INFERRED_MATRIX)
         ) {
             right.first._type = Value::INFERRED_MATRIX;
             right.first._dimension = left.first.get_dimension();
-            const std::string& ident_name = node->left->get_label();
+            const std::string& ident_name = node.left().get_label();
 
-            if (global_idents.count(ident_name) > 0) {
-                global_idents[ident_name] = Value(left.first.get_matrix());
+            if (ctx.idents.count(ident_name) > 0) {
+                ctx.idents[ident_name] = left.first.as_matrix();
             } else {
                 if (inside_func_or_block) {
                     for (int i = 0; i < local_vars.size(); i++) {
                         if (local_vars[i].first == ident_name) {
-                            local_vars[i].second = Value(left.first.get_matrix());
+                            local_vars[i].second = left.first.as_matrix();
                         }
                     }
                 }
@@ -721,14 +728,14 @@ std::pair<Value, std::vector<std::pair<std::string, Value>>> analyse(
             current_tag == Tag::MUL &&
             (left.first._type == Value::MATRIX || left.first._type == Value::INFERRED_MATRIX) &&
             (right.first._type == Value::MATRIX || right.first._type == Value::INFERRED_MATRIX) &&
-            (left.first.get_matrix()[0].size() == right.first.get_matrix().size())
+            (left.first.cols() == right.first.rows())
         )) {
             if (left.first._type == Value::UNDEFINED) {
                 throw std::invalid_argument(
                         "Undefined value: " +
                         to_string(left.first) +
                         " in node: " +
-                        node->toString()
+                        node.toString()
                 );
             }
 
@@ -737,7 +744,7 @@ std::pair<Value, std::vector<std::pair<std::string, Value>>> analyse(
                         "Undefined value: " +
                         to_string(right.first) +
                         " in node: " +
-                        node->toString()
+                        node.toString()
                 );
             }
 
@@ -747,17 +754,16 @@ std::pair<Value, std::vector<std::pair<std::string, Value>>> analyse(
                     " and value: " +
                     to_string(right.first) +
                     " in node: " +
-                    node->toString()
+                    node.toString()
             );
         }
 
         if (current_tag == Tag::MUL) {
             if (left.first._type == Value::MATRIX || left.first._type == Value::INFERRED_MATRIX) {
                 return {
-                    {
-                        left.first.get_matrix(),
+                    left.first.as_matrix(
                         Value::sum_dimensions(left.first.get_dimension(), right.first.get_dimension())
-                    },
+                    ),
                     right.second
                 };
             } else {
@@ -775,8 +781,8 @@ std::pair<Value, std::vector<std::pair<std::string, Value>>> analyse(
     }
 
     if (current_tag == Tag::POW) {
-        auto left = analyse(node->left, inside_func_or_block, local_vars, is_usub);
-        auto right = analyse(node->right, inside_func_or_block, left.second, is_usub);
+        auto left = analyse(ctx, node.left(), inside_func_or_block, local_vars, is_usub);
+        auto right = analyse(ctx, node.right(), inside_func_or_block, left.second, is_usub);
 
         if (!(
             (left.first._type == Value::DOUBLE || left.first._type == Value::INFERRED_DOUBLE) &&
@@ -790,7 +796,7 @@ std::pair<Value, std::vector<std::pair<std::string, Value>>> analyse(
                         "Undefined value: " +
                         to_string(left.first) +
                         " in node: " +
-                        node->toString()
+                        node.toString()
                 );
             }
 
@@ -799,7 +805,7 @@ std::pair<Value, std::vector<std::pair<std::string, Value>>> analyse(
                         "Undefined value: " +
                         to_string(right.first) +
                         " in node: " +
-                        node->toString()
+                        node.toString()
                 );
             }
 
@@ -809,7 +815,7 @@ std::pair<Value, std::vector<std::pair<std::string, Value>>> analyse(
                     " and value: " +
                     to_string(right.first) +
                     " in node: " +
-                    node->toString()
+                    node.toString()
             );
         }
 
@@ -820,9 +826,13 @@ std::pair<Value, std::vector<std::pair<std::string, Value>>> analyse(
     }
 
     if (current_tag == Tag::SUM || current_tag == Tag::PRODUCT) {
-        auto left = analyse(node->left, inside_func_or_block, local_vars, is_usub);
-        auto cond = analyse(node->cond, inside_func_or_block, left.second, is_usub);
-        auto right = analyse(node->right, inside_func_or_block, cond.second, is_usub);
+        //left - равенство i = a, cond - верхняя граница, тело видит переменную цикла как локальную
+        auto left = analyse(ctx, node.left().right(), inside_func_or_block, local_vars, is_usub);
+        auto cond = analyse(ctx, node.cond(), inside_func_or_block, left.second, is_usub);
+
+        auto body_vars = cond.second;
+        body_vars.emplace_back(node.left().left().get_label(), Value(0.0, Value::dimensionless));
+        auto right = analyse(ctx, node.right(), true, body_vars, is_usub);
 
         if (!(
             (left.first._type == Value::DOUBLE || left.first._type == Value::INFERRED_DOUBLE) &&
@@ -835,7 +845,7 @@ std::pair<Value, std::vector<std::pair<std::string, Value>>> analyse(
                         "Undefined value: " +
                         to_string(left.first) +
                         " in node: " +
-                        node->toString()
+                        node.toString()
                 );
             }
 
@@ -844,7 +854,7 @@ std::pair<Value, std::vector<std::pair<std::string, Value>>> analyse(
                         "Undefined value: " +
                         to_string(right.first) +
                         " in node: " +
-                        node->toString()
+                        node.toString()
                 );
             }
 
@@ -854,32 +864,32 @@ std::pair<Value, std::vector<std::pair<std::string, Value>>> analyse(
                     " and value: " +
                     to_string(cond.first) +
                     " in node: " +
-                    node->toString()
+                    node.toString()
             );
         }
 
         if (current_tag == Tag::SUM) {
-            return analyse(node->right, inside_func_or_block, local_vars, is_usub);
+            return {right.first, cond.second};
         } else {
             return {
                 Value::mul_dimensions(
                     right.first.get_dimension(),
-                    floor(cond.first.get_double() - left.first.get_double())
+                    floor(cond.first.get_double() - left.first.get_double()) + 1
                 ),
-                right.second
+                cond.second
             };
         }
     }
 
     if (current_tag == Tag::DIMENSION) {
         return {
-            {dimensions.find(node->get_label())->second},
+            {*dimensions.find(node.get_label())},
             local_vars
         };
     }
 
     if (current_tag == Tag::ABS) {
-        auto right = analyse(node->right, inside_func_or_block, local_vars, is_usub);
+        auto right = analyse(ctx, node.right(), inside_func_or_block, local_vars, is_usub);
 
         if (right.first._type != Value::DOUBLE && right.first._type != Value::INFERRED_DOUBLE) {
             if (right.first._type == Value::UNDEFINED) {
@@ -887,7 +897,7 @@ std::pair<Value, std::vector<std::pair<std::string, Value>>> analyse(
                         "Undefined value: " +
                         to_string(right.first) +
                         " in node: " +
-                        node->toString()
+                        node.toString()
                 );
             }
 
@@ -895,7 +905,7 @@ std::pair<Value, std::vector<std::pair<std::string, Value>>> analyse(
                     "Cannot use ABS operator on non double value: " +
                     to_string(right.first) +
                     " in node: " +
-                    node->toString()
+                    node.toString()
             );
         }
 
@@ -903,23 +913,23 @@ std::pair<Value, std::vector<std::pair<std::string, Value>>> analyse(
     }
 
     if (current_tag == Tag::EQ) {
-        if (node->right->get_tag() != Tag::PLACEHOLDER) {
-            return analyse(node->right, inside_func_or_block, local_vars, is_usub);
+        if (node.right().get_tag() != Tag::PLACEHOLDER) {
+            return analyse(ctx, node.right(), inside_func_or_block, local_vars, is_usub);
         } else {
-            return analyse(node->left, inside_func_or_block, local_vars, is_usub);
+            return analyse(ctx, node.left(), inside_func_or_block, local_vars, is_usub);
         }
     }
 
     if (current_tag == Tag::SET) {
         if (inside_func_or_block) {
-            const std::string& ident_name = node->left->get_label();
+            const std::string& ident_name = node.left().get_label();
 
-//            if (global_idents.count(ident_name) > 0) {
+//            if (ctx.idents.count(ident_name) > 0) {
 //                throw std::invalid_argument(
 //                        "Local ident with name: " +
 //                        ident_name +
 //                        " is already exists in global scope, node: " +
-//                        node->toString()
+//                        node.toString()
 //                );
 //            }
 //
@@ -929,12 +939,12 @@ std::pair<Value, std::vector<std::pair<std::string, Value>>> analyse(
 //                            "Local ident with name: " +
 //                            ident_name +
 //                            " is already exists in local scope, node: " +
-//                            node->toString()
+//                            node.toString()
 //                    );
 //                }
 //            }
 
-            const auto& res = analyse(node->right, inside_func_or_block, local_vars, is_usub);
+            const auto& res = analyse(ctx, node.right(), inside_func_or_block, local_vars, is_usub);
 
             for (int i = 0; i < local_vars.size(); i++) {
                 if (local_vars[i].first == ident_name) {
@@ -947,66 +957,67 @@ std::pair<Value, std::vector<std::pair<std::string, Value>>> analyse(
 
             return {res.first, local_vars};
         } else {
-            if (node->left->get_tag() == Tag::IDENT) {
-                const std::string& ident_name = node->left->get_label();
+            if (node.left().get_tag() == Tag::IDENT) {
+                const std::string& ident_name = node.left().get_label();
 
-//                if (global_idents.count(ident_name) > 0) {
+//                if (ctx.idents.count(ident_name) > 0) {
 //                    throw std::invalid_argument(
 //                            "Global ident with name: " +
 //                            ident_name +
 //                            " is already exists, node: " +
-//                            node->toString()
+//                            node.toString()
 //                    );
 //                }
 
-                global_idents.emplace(
+                ctx.idents.emplace(
                     ident_name,
-                    analyse(node->right, inside_func_or_block, local_vars, is_usub).first
+                    analyse(ctx, node.right(), inside_func_or_block, local_vars, is_usub).first
                 );
 
                 return {
                     Value(),
                     local_vars
                 };
-            } else if (node->left->get_tag() == Tag::FUNC) {
+            } else if (node.left().get_tag() == Tag::FUNC) {
                 std::vector<std::pair<std::string, Value>> res;
-                for (const auto field : node->left->fields) {
-                    if (field->get_tag() != Tag::IDENT) {
+                for (const auto field : node.left().fields()) {
+                    if (field.get_tag() != Tag::IDENT) {
                         throw std::invalid_argument(
                                 "FUNC arg is not an IDENT: " +
-                                field->toString() +
+                                field.toString() +
                                 " , node: " +
-                                node->toString()
+                                node.toString()
                         );
                     }
 
                     for (const auto& arg : res) {
-                        if (arg.first == field->get_label()) {
+                        if (arg.first == field.get_label()) {
                             throw std::invalid_argument(
                                     "FUNC arg is already exists: " +
-                                    field->toString() +
+                                    field.toString() +
                                     " , node: " +
-                                    node->toString()
+                                    node.toString()
                             );
                         }
                     }
 
-                    res.emplace_back(field->get_label(), Value());
+                    res.emplace_back(field.get_label(), Value());
                 }
 
                 const auto& to_return = analyse(
-                    node->right,
+                    ctx,
+                    node.right(),
                     true,
                     res,
                     is_usub
                 );
 
-                global_funcs.emplace(node->left->get_label(), to_return.first);
+                ctx.funcs.emplace(node.left().get_label(), to_return.first);
 
-                global_funcs_body.emplace(
-                        node->left->get_label(),
-                        std::pair<Node*, std::vector<std::pair<std::string, Value>>>(
-                            node->right,
+                ctx.funcs_body.emplace(
+                        node.left().get_label(),
+                        std::pair<Node, std::vector<std::pair<std::string, Value>>>(
+                            node.right(),
                             std::vector<std::pair<std::string, Value>>(
                                     to_return.second.begin(),
                                     to_return.second.begin() + (long) res.size()
@@ -1016,18 +1027,19 @@ std::pair<Value, std::vector<std::pair<std::string, Value>>> analyse(
 
                 return to_return;
             } else {
-                throw std::invalid_argument("Cannot analyse SET statement: " + node->toString());
+                throw std::invalid_argument("Cannot analyse SET statement: " + node.toString());
             }
         }
     }
 
     if (current_tag == Tag::BEGINB) {
-        for (int i = 0; i < node->fields.size(); ++i) {
-            if (i == node->fields.size() - 1) {
-                return analyse(node->fields[i], true, local_vars, is_usub);
+        for (int i = 0; i < node.fields().size(); ++i) {
+            if (i == node.fields().size() - 1) {
+                return analyse(ctx, node.fields()[i], true, local_vars, is_usub);
             } else {
                 const auto& res = analyse(
-                    node->fields[i],
+                    ctx,
+                    node.fields()[i],
                     true,
                     local_vars,
                     is_usub
@@ -1041,13 +1053,13 @@ std::pair<Value, std::vector<std::pair<std::string, Value>>> analyse(
         Matrix m;
         Value x;
 
-        if (!node->fields.empty() && !node->fields[0]->fields.empty()) {
-            x = analyse(node->fields[0]->fields[0], inside_func_or_block, local_vars, is_usub).first;
+        if (!node.fields().empty() && !node.fields()[0].fields().empty()) {
+            x = analyse(ctx, node.fields()[0].fields()[0], inside_func_or_block, local_vars, is_usub).first;
         }
 
-        for (const auto& field : node->fields) {
+        for (const auto& field : node.fields()) {
             std::vector<Value> v;
-            for (const auto& jt : field->fields) {
+            for (const auto& jt : field.fields()) {
                 v.push_back(x);
             }
             m.push_back(v);
@@ -1056,8 +1068,8 @@ std::pair<Value, std::vector<std::pair<std::string, Value>>> analyse(
     }
 
     if (current_tag == Tag::WHILE) {
-        analyse(node->cond, inside_func_or_block, local_vars, is_usub);
-        return analyse(node->right, inside_func_or_block, local_vars, is_usub);
+        analyse(ctx, node.cond(), inside_func_or_block, local_vars, is_usub);
+        return analyse(ctx, node.right(), inside_func_or_block, local_vars, is_usub);
     }
 
     if (
@@ -1081,12 +1093,12 @@ std::pair<Value, std::vector<std::pair<std::string, Value>>> analyse(
     }
 
     if (current_tag == Tag::IF) {
-        const auto& res = analyse(node->cond, inside_func_or_block, local_vars, is_usub);
-        return analyse(node->right, inside_func_or_block, res.second, is_usub);
+        const auto& res = analyse(ctx, node.cond(), inside_func_or_block, local_vars, is_usub);
+        return analyse(ctx, node.right(), inside_func_or_block, res.second, is_usub);
     }
 
     if (current_tag == Tag::TRANSP) {
-        const auto& res = analyse(node->left, inside_func_or_block, local_vars, is_usub);
+        const auto& res = analyse(ctx, node.left(), inside_func_or_block, local_vars, is_usub);
 
         return {
             Value::transpose(res.first),
@@ -1094,5 +1106,5 @@ std::pair<Value, std::vector<std::pair<std::string, Value>>> analyse(
         };
     }
 
-    throw std::invalid_argument("Cannot analyse node: " + node->toString());
+    throw std::invalid_argument("Cannot analyse node: " + node.toString());
 }
\ No newline at end of file
@@ -12,15 +12,26 @@
 #include "Value.h"
 
 
-class TypeVariable: public Node {
+//тип в выводе типов
+class Type {
 public:
-    Node* instance;
+    std::string label;
+
+    virtual ~Type() = default;
+
+    std::string& toString();
+};
+
+
+class TypeVariable: public Type {
+public:
+    Type* instance;
 
     TypeVariable();
 };
 
 
-class TypeOperator: public Node {
+class TypeOperator: public Type {
 public:
     std::string name;
     std::vector<TypeVariable*> types;
@@ -30,26 +41,27 @@ public:
 
 bool is_number(const std::string& name);
 
-Node* get_base_type(Node* object);
+Type* get_base_type(Type* object);
 
-bool any_type_match(Node* target, const std::vector<TypeVariable*>& source);
+bool any_type_match(Type* target, const std::vector<TypeVariable*>& source);
 
-bool type_match(Node* target, Node* source);
+bool type_match(Type* target, Type* source);
 
-bool is_generic_type(Node* target, const std::vector<TypeVariable *> &source);
+bool is_generic_type(Type* target, const std::vector<TypeVariable *> &source);
 
-void unification(Node* type1, Node* type2);
+void unification(Type* type1, Type* type2);
 
-Node* copy_type_rec(
-        Node* type,
+Type* copy_type_rec(
+        Type* type,
         const std::vector<TypeVariable *> &non_generic,
         std::map<TypeVariable*, TypeVariable*> mapping
 );
 
-Node* copy_type(Node* type, const std::vector<TypeVariable *> &non_generic);
+Type* copy_type(Type* type, const std::vector<TypeVariable *> &non_generic);
 
 std::pair<Value, std::vector<std::pair<std::string, Value>>> analyse(
-    Node *node,
+    Context &ctx,
+    Node node,
     bool inside_func_or_block,
     std::vector<std::pair<std::string, Value>> local_vars,
     bool is_usub
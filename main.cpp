@@ -1,4 +1,8 @@
 #include <iostream>
+#include <sstream>
+#include <atomic>
+#include <future>
+#include <memory>
 #include "Defines.h"
 #include "Coordinate.h"
 #include "Error.h"
@@ -6,144 +10,265 @@
 #include "Lexer.h"
 #include "Node.h"
 #include "Value.h"
+#include "ThreadPool.h"
+#include "Context.h"
+#include "Schedule.h"
+#include "Cache.h"
+#include "Watch.h"
 #include <ctime>
 #include <chrono>
 
 
-ProgramString Position::ps;
-name_table Node::global;
-replacement_map Node::reps;
-
-
-std::string make_replacement(const std::string& prog, const replacement_map& m) {
-	std::string res;
-	size_t index = 0;
-
-//	std::cout << "make_replacement.size = " << m.size() << std::endl;
-
-	for (auto& it : m) {
-		res += prog.substr(index, it.second.begin - index);
-		if (it.second.tag == GRAPHIC) {
-			res += "{" + to_plot(it.second.replacement) + "}";
-		}
-		else {
-//		    std::cout << "second.replacement = " << to_string((*it).second.replacement) << std::endl;
-			res += "{" + to_string(it.second.replacement) + "}";
-		}
-		index = it.second.end;
-	}
-	res += prog.substr(index);
-	return res;
+//имя временного выходного файла при перезаписи: "_" перед именем файла, в той же директории
+std::string temp_name(const std::string& file_in) {
+    size_t slash = file_in.rfind('/');
+    size_t name = (slash == std::string::npos) ? 0 : slash + 1;
+    return file_in.substr(0, name) + "_" + file_in.substr(name);
 }
 
-int main(int argc, char *argv[]) {
-    auto start = std::chrono::steady_clock::now();
-
-    Parser B;
-
+//обработать один файл; сообщения об ошибках пишутся в log, возвращает true при успехе.
+//Если есть pool, лексер и парсер всех блоков работают на нем параллельно, а операторы выполняются
+//по графу зависимостей (с кэшем - блоками в порядке документа, как только готов очередной блок)
+bool process_file(const char *file_in, const char *file_out, bool replace, std::ostream& log, Cache *cache,
+                  ThreadPool *pool, bool vm) {
 	bool ok = true;
-	bool replace = false;   //файл не будет перезаписан по-умолчанию
-
-	const char *file_in;
-	const char *file_out;
-
-	if (argc < 2 || argc > 3) { //число аргументов должно быть равно 1 или 2
-		file_in = "test.tex";
-		file_out = "_test.tex";
-//		replace = true;
-//		std::cerr << "Usage: " << argv[0] << " input [output]" << std::endl;
-//		return 1;
-	} else {
-		file_in = argv[1];
-		if (argc == 2 || !std::strcmp(file_in, argv[2])) { //если указан один аргумент или 1 и 2 аргументы совпадают
-			file_out = new char[std::strlen(file_in) + 2];        //то файл будет перезаписан
-			std::strcpy(const_cast<char *>(file_out), "_");
-			std::strcat(const_cast<char *>(file_out), file_in);
-			replace = true;
-		}
-		else {
-            file_out = argv[2];
-        }
-	}
 
-//	std::cout << file_in;
-//	std::cout << file_out;
+	Context ctx;    //у каждого файла свой контекст, файлы пакета не влияют друг на друга
+	ctx.cache = cache;  //кэш общий, он сам защищен мьютексом
+	ctx.vm = vm;
 
-	FileHandler &fh = FileHandler::Instance(file_in, file_out);
+	FileHandler fh(file_in, file_out);
 	if (!fh.good()) {
-		std::cerr << file_in << ":" << "Failed to initialize" << std::endl;
+		log << file_in << ":" << "Failed to initialize" << std::endl;
 		ok = false;
 	}
 
-	Node *res;
-	while (ok) {
-		Position::ps = fh.next();
-        if (Position::ps.program.empty()) {
-            break;
-        }
-		Lexer l;
-		try {
-			std::vector<Token> p = l.program_to_tokens(Position::ps);
-//			for (auto& i : p) {
-//                printf("%s\n", to_string(i).c_str());
-//            }
-			B.init(p);
-//            std::cout << "after B.init(p);\n";
-			res = new Node();
-//            std::cout << "after res = new Node();\n";
-			res->fields = B.block(NONE);
-//            std::cout << "after B.block(NONE);\n";
-			res->set_tag(ROOT);
-//			res->print("");
-//            std::cout << "after res->print(\"\");\n";
-
-            // Стадия семантического анализа для проверки корректности операций с размерными физическими величинами
-            res->semantic_analysis();
-
-			res->exec({});
-//			std::cout << "after exec()\n";
-
-			//std::string replacement = Position::ps.program;
-			std::string replacement = make_replacement(Position::ps.program, Node::reps);
-//			std::cout << "after replacement\n";
-			fh.print_to_out(replacement);
-//			std::cout << "fh.print_to_out\n";
-			Node::reps.clear();
-		}
-		catch (Error& err) {
-		    std::cout << "catch (Error err)\n";
-			std::cerr << file_in << ":" << err.what() << std::endl;
-			ok = false;
-		}
-		catch (Value::BadType& err) {
-            std::cout << "catch (Value::BadType err\n)";
-			std::cerr << file_in << ":" << err.what() << std::endl;
-			ok = false;
-		}
-		catch (std::exception& err) {
-            std::cout << "catch (std::exception err)\n";
-			std::cerr << file_in << ":" << err.what() << std::endl;
-			ok = false;
-		}
+	std::vector<ProgramString> blocks;  //не меняется, пока работают задачи: токены ссылаются на элементы
+	for (ProgramString ps = fh.scan(); ok && !ps.program.empty(); ps = fh.scan()) {
+		blocks.push_back(ps);
+	}
+	std::vector<Parsed> parsed(blocks.size());
+	std::vector<std::promise<void>> ready(pool ? blocks.size() : 0);
+	std::vector<std::future<void>> done;
+	for (size_t i = 0; i < ready.size(); ++i) {
+		done.push_back(ready[i].get_future());
+		pool->submit([&blocks, &parsed, &ready, i] {
+			parse_block(blocks[i], parsed[i]);
+			ready[i].set_value();
+		});
+	}
 
-        delete res;
+	try {
+		if (pool && !cache) {   //все блоки сразу: независимые операторы выполняются параллельно
+			for (auto& d : done) {
+				d.wait();
+			}
+			if (ok) {
+				Schedule(ctx, parsed).run(*pool);
+			}
+			for (size_t i = 0; ok && i < blocks.size(); ++i) {
+				fh.copy_to(blocks[i]);
+				make_replacement(blocks[i].program, parsed[i].reps, fh.out());
+				parsed[i].root = Node();
+				parsed[i].ast.clear();
+			}
+		} else {
+			for (size_t i = 0; ok && i < blocks.size(); ++i) {
+				fh.copy_to(blocks[i]);
+				if (pool) {
+					done[i].wait();
+					ctx.run(blocks[i], parsed[i], fh.out());
+				} else {
+					ctx.run(blocks[i], fh.out());
+				}
+			}
+		}
+	}
+	catch (Error& err) {
+	    std::cout << "catch (Error err)\n";
+		log << file_in << ":" << err.what() << std::endl;
+		ok = false;
+	}
+	catch (Value::BadType& err) {
+        std::cout << "catch (Value::BadType err\n)";
+		log << file_in << ":" << err.what() << std::endl;
+		ok = false;
+	}
+	catch (std::exception& err) {
+        std::cout << "catch (std::exception err)\n";
+		log << file_in << ":" << err.what() << std::endl;
+		ok = false;
+	}
+	for (auto& d : done) {  //задачи ссылаются на blocks и parsed
+		d.wait();
 	}
 
 	if (ok) {                   //если удалось обработать файл и
+		fh.copy_to(ProgramString());
 		if (replace) {          //если надо перезаписать файл
-			fh.replace_files();
+			ok = !fh.replace_files();
 		}
 	} else { //если не удалось обработать файл, то удалить выходной файл
 		fh.remove_out();
 	}
+	return ok;
+}
+
+typedef struct Job {
+    std::string in;
+    std::string out;
+    bool replace;
+} Job;
+
+Job make_job(const std::string& in, const std::string& out = "") {
+    if (out.empty() || out == in) {     //если выходной файл не указан или совпадает с входным,
+        return {in, temp_name(in), true};    //то файл будет перезаписан
+    }
+    return {in, out, false};
+}
+
+//строки списка: "входной_файл [выходной_файл]", пустые строки и строки с # пропускаются
+bool read_list(const char *path, std::vector<Job>& jobs) {
+    std::ifstream list(path);
+    if (!list.good()) return false;
+    std::string line;
+    while (std::getline(list, line)) {
+        std::istringstream ss(line);
+        std::string in, out;
+        if (!(ss >> in) || in[0] == '#') continue;
+        ss >> out;
+        jobs.push_back(make_job(in, out));
+    }
+    return true;
+}
 
-//	if (replace) {
-//	    delete[] file_out;
-//	}
+//пакетный режим: файлы обрабатываются параллельно на workers потоках
+int run_batch(const std::vector<Job>& jobs, size_t workers, Cache *cache, bool vm) {
+    std::mutex log_mutex;
+    std::atomic<size_t> failed(0);
+    {
+        ThreadPool pool(std::min(workers ? workers : std::thread::hardware_concurrency(), jobs.size()));
+        for (const Job& job : jobs) {
+            pool.submit([&job, &log_mutex, &failed, cache, vm] {
+                std::ostringstream log;
+                bool ok = false;
+                try {
+                    ok = process_file(job.in.c_str(), job.out.c_str(), job.replace, log, cache, nullptr, vm);
+                }
+                catch (std::exception& err) {
+                    log << job.in << ":" << err.what() << std::endl;
+                }
+                if (!ok) {
+                    ++failed;
+                    std::lock_guard<std::mutex> lock(log_mutex);
+                    std::cerr << log.str() << job.in << ": FAILED" << std::endl;
+                }
+            });
+        }
+        pool.wait();
+    }
+    if (failed) {
+        std::cerr << failed << " of " << jobs.size() << " files failed" << std::endl;
+    }
+    return failed ? 1 : 0;
+}
+
+int main(int argc, char *argv[]) {
+    auto start = std::chrono::steady_clock::now();
+
+    int rc = 0;
+
+    //--cache file, --cache-stats и --vm допустимы в любом режиме, остальные аргументы разбираются без них
+    Cache cache;
+    const char *cache_file = nullptr;
+    bool cache_stats = false;
+    bool vm = false;    //выполнять операторы байт-кодом, а не обходом дерева
+    std::vector<char*> args;
+    for (int i = 0; i < argc; ++i) {
+        if (!std::strcmp(argv[i], "--cache") && i + 1 < argc) {
+            cache_file = argv[++i];
+        } else if (!std::strcmp(argv[i], "--cache-stats")) {
+            cache_stats = true;
+        } else if (!std::strcmp(argv[i], "--vm")) {
+            vm = true;
+        } else {
+            args.push_back(argv[i]);
+        }
+    }
+    argc = args.size();
+    argv = args.data();
+    if (cache_file) {
+        cache.load(cache_file);
+    }
+
+    if (argc >= 2 && !std::strcmp(argv[1], "--watch")) {
+        //tex-preprocessor --watch input ...; выходной файл - "_" перед именем входного, вход не перезаписывается
+        std::vector<std::pair<std::string, std::string>> files;
+        for (int i = 2; i < argc; ++i) {
+            files.emplace_back(argv[i], temp_name(argv[i]));
+        }
+        if (files.empty()) {
+            std::cerr << "Usage: " << argv[0] << " --watch input ..." << std::endl;
+            return 1;
+        }
+        return watch(files, vm);
+    }
+
+    if (argc >= 2 && !std::strcmp(argv[1], "--batch")) {
+        //tex-preprocessor --batch [-j N] [-l list] [--cache file [--cache-stats]] [input ...]
+        std::vector<Job> jobs;
+        size_t workers = 0;
+        for (int i = 2; i < argc; ++i) {
+            if (!std::strcmp(argv[i], "-j") && i + 1 < argc) {
+                workers = std::strtoul(argv[++i], nullptr, 10);
+            } else if (!std::strcmp(argv[i], "-l") && i + 1 < argc) {
+                if (!read_list(argv[++i], jobs)) {
+                    std::cerr << argv[i] << ":" << "Failed to read list" << std::endl;
+                    return 1;
+                }
+            } else {
+                jobs.push_back(make_job(argv[i]));
+            }
+        }
+        if (jobs.empty()) {
+            std::cerr << "Usage: " << argv[0] << " --batch [-j N] [-l list] [input ...]" << std::endl;
+            return 1;
+        }
+        rc = run_batch(jobs, workers, cache_file ? &cache : nullptr, vm);
+    } else {
+        Job job;
+        if (argc < 2 || argc > 3) { //число аргументов должно быть равно 1 или 2
+            job = {"test.tex", "_test.tex", false};
+//            std::cerr << "Usage: " << argv[0] << " input [output]" << std::endl;
+//            return 1;
+        } else {
+            job = make_job(argv[1], (argc == 3) ? argv[2] : "");
+        }
+        //в пакетном режиме параллельны файлы, здесь - блоки одного файла
+        std::unique_ptr<ThreadPool> pool;
+        if (std::thread::hardware_concurrency() > 1) {
+            pool.reset(new ThreadPool());
+        }
+        rc = process_file(job.in.c_str(), job.out.c_str(), job.replace, std::cerr, cache_file ? &cache : nullptr,
+                          pool.get(), vm) ? 0 : 1;
+    }
+
+    if (cache_file) {
+        if (!cache.save()) {
+            std::cerr << cache_file << ":" << "Failed to save cache" << std::endl;
+        }
+        if (cache_stats) {
+            CacheStats st = cache.stats();
+            size_t total = st.hits + st.misses + st.invalidated;
+            std::cerr << "cache: " << st.hits << " hits, " << st.misses << " misses, "
+                      << st.invalidated << " invalidated, " << st.uncacheable << " uncacheable (hit rate "
+                      << (total ? 100 * st.hits / total : 0) << "%)" << std::endl;
+        }
+    }
 
     auto end = std::chrono::steady_clock::now();
     auto diff = end - start;
     std::cout << std::chrono::duration <double, std::milli> (diff).count() << std::endl;
 
-    return 0;
-}
\ No newline at end of file
+    return rc;
+}
@@ -0,0 +1,33 @@
+#запуск препроцессора на tests/<имя>.tex и сравнение результата с tests/<имя>.expected
+#BIN - исполняемый файл, IN, EXPECTED, OUT - пути, FLAGS - дополнительные аргументы (--vm),
+#без EXPECTED обработка должна завершиться ошибкой и не оставить выходного файла;
+#CACHE - файл кэша, который копируется в OUT.cache перед запуском
+file(REMOVE ${OUT})
+if (DEFINED CACHE)
+    configure_file(${CACHE} ${OUT}.cache COPYONLY)
+    list(APPEND FLAGS --cache ${OUT}.cache)
+endif ()
+
+execute_process(
+        COMMAND ${BIN} ${FLAGS} ${IN} ${OUT}
+        RESULT_VARIABLE rc
+        OUTPUT_QUIET
+)
+if (NOT DEFINED EXPECTED)
+    if (rc EQUAL 0 OR EXISTS ${OUT})
+        message(FATAL_ERROR "${IN}: expected to fail, exit code ${rc}")
+    endif ()
+    return()
+endif ()
+if (NOT rc EQUAL 0)
+    message(FATAL_ERROR "${IN}: exit code ${rc}")
+endif ()
+
+execute_process(
+        COMMAND ${CMAKE_COMMAND} -E compare_files ${OUT} ${EXPECTED}
+        RESULT_VARIABLE diff
+)
+if (NOT diff EQUAL 0)
+    file(READ ${OUT} got)
+    message(FATAL_ERROR "${IN}: output differs from ${EXPECTED}:\n${got}")
+endif ()